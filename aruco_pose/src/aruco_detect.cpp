@@ -15,10 +15,14 @@
  */
 
 #include <math.h>
+#include <cctype>
 #include <vector>
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <mutex>
 #include <ros/ros.h>
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
@@ -27,6 +31,7 @@
 #include <tf2_ros/transform_listener.h>
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+#include <tf2_msgs/TFMessage.h>
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 #include <geometry_msgs/Vector3.h>
@@ -47,6 +52,9 @@
 #include <aruco_pose/MarkerArray.h>
 
 #include "utils.h"
+#include "tracker.h"
+#include "latency.h"
+#include "fused.h"
 
 using std::vector;
 using cv::Mat;
@@ -58,17 +66,36 @@ private:
 	tf2_ros::Buffer tf_buffer_;
 	tf2_ros::TransformListener tf_listener_{tf_buffer_};
 	cv::Ptr<cv::aruco::Dictionary> dictionary_;
-	cv::Ptr<cv::aruco::DetectorParameters> parameters_;
+	cv::Ptr<cv::aruco::DetectorParameters> parameters_, scaled_parameters_;
 	image_transport::Publisher debug_pub_;
 	image_transport::CameraSubscriber img_sub_;
-	ros::Publisher markers_pub_, vis_markers_pub_;
-	bool estimate_poses_, send_tf_, auto_flip_;
+	ros::Publisher markers_pub_, vis_markers_pub_, diagnostics_pub_;
+	ros::Subscriber predicted_sub_, tf_static_sub_;
+	bool estimate_poses_, send_tf_, auto_flip_, tracking_, roi_detection_;
+	double roi_margin_, detection_scale_, tiles_full_scale_;
+	ros::Duration roi_timeout_;
+	int roi_full_interval_, roi_frames_ = 0;
+	std::mutex predicted_mutex_;
+	aruco_pose::MarkerArrayConstPtr predicted_;
+	int tiles_, tiles_overlap_, threads_;
+	vector<cv::Rect> rois_;
+	vector<vector<int>> regions_ids_;
+	vector<vector<vector<cv::Point2f>>> regions_corners_;
 	double length_;
 	std::unordered_map<int, double> length_override_;
+	std::map<double, vector<int>> length_groups_;
+	std::unordered_map<int, std::string> child_frame_ids_;
+	std::unordered_set<int> static_markers_; // ids of markers with static frames
+	std::mutex static_markers_mutex_;
 	std::string frame_id_prefix_, known_tilt_;
+	ros::Duration known_tilt_timeout_, known_tilt_max_age_;
 	Mat camera_matrix_, dist_coeffs_;
+	CameraIntrinsics intrinsics_;
 	aruco_pose::MarkerArray array_;
 	visualization_msgs::MarkerArray vis_array_;
+	vector<geometry_msgs::TransformStamped> transforms_;
+	MarkerTracker tracker_;
+	LatencyStats latency_;
 
 public:
 	virtual void onInit()
@@ -87,24 +114,65 @@ public:
 		readLengthOverride();
 
 		nh_priv_.param<std::string>("known_tilt", known_tilt_, "");
+		known_tilt_timeout_ = ros::Duration(nh_priv_.param("known_tilt_timeout", 0.02));
+		known_tilt_max_age_ = ros::Duration(nh_priv_.param("known_tilt_max_age", 0.0));
 		nh_priv_.param("auto_flip", auto_flip_, false);
 
 		nh_priv_.param<std::string>("frame_id_prefix", frame_id_prefix_, "aruco_");
 
-		camera_matrix_ = cv::Mat::zeros(3, 3, CV_64F);
-		dist_coeffs_ = cv::Mat::zeros(8, 1, CV_64F);
+		nh_priv_.param("diagnostics", latency_.enabled, false);
+
+		nh_priv_.param("tracking", tracking_, false);
+		nh_priv_.param("tracking_keyframe_interval", tracker_.keyframe_interval, 10);
+		nh_priv_.param("tracking_max_error", tracker_.max_error, 1.0);
+
+		nh_priv_.param("roi_detection", roi_detection_, false);
+		nh_priv_.param("roi_margin", roi_margin_, 0.5);
+		nh_priv_.param("roi_full_interval", roi_full_interval_, 10);
+		roi_timeout_ = ros::Duration(nh_priv_.param("roi_timeout", 0.5));
+
+		camera_matrix_ = intrinsics_.matrix;
+		dist_coeffs_ = intrinsics_.dist;
 
 		dictionary_ = cv::aruco::getPredefinedDictionary(static_cast<cv::aruco::PREDEFINED_DICTIONARY_NAME>(dictionary));
 		parameters_ = cv::aruco::DetectorParameters::create();
 		parameters_->cornerRefinementMethod = cv::aruco::CORNER_REFINE_SUBPIX;
 
+		nh_priv_.param("detection_scale", detection_scale_, 1.0);
+		if (detection_scale_ <= 0 || detection_scale_ > 1) {
+			ROS_FATAL("aruco_detect: ~detection_scale should be in (0, 1] range");
+			ros::shutdown();
+		}
+
+		nh_priv_.param("tiles", tiles_, 1);
+		nh_priv_.param("tiles_overlap", tiles_overlap_, 50);
+		nh_priv_.param("tiles_full_scale", tiles_full_scale_, 0.5);
+		if (tiles_full_scale_ < 0 || tiles_full_scale_ > 1) {
+			ROS_FATAL("aruco_detect: ~tiles_full_scale should be in [0, 1] range");
+			ros::shutdown();
+		}
+		nh_priv_.param("threads", threads_, 0);
+
+		// corners are refined on the full resolution image
+		scaled_parameters_ = cv::makePtr<cv::aruco::DetectorParameters>(*parameters_);
+		scaled_parameters_->cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
+
 		image_transport::ImageTransport it(nh_);
 		image_transport::ImageTransport it_priv(nh_priv_);
 
 		debug_pub_ = it_priv.advertise("debug", 1);
 		markers_pub_ = nh_priv_.advertise<aruco_pose::MarkerArray>("markers", 1);
 		vis_markers_pub_ = nh_priv_.advertise<visualization_msgs::MarkerArray>("visualization", 1);
+		if (latency_.enabled) {
+			diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+		}
 		img_sub_ = it.subscribeCamera("image_raw", 1, &ArucoDetect::imageCallback, this);
+		if (send_tf_) {
+			tf_static_sub_ = nh_.subscribe("/tf_static", 100, &ArucoDetect::tfStaticCallback, this);
+		}
+		if (roi_detection_) {
+			predicted_sub_ = nh_.subscribe("predicted_markers", 1, &ArucoDetect::predictedCallback, this);
+		}
 
 		ROS_INFO("aruco_detect: ready");
 	}
@@ -112,58 +180,54 @@ public:
 private:
 	void imageCallback(const sensor_msgs::ImageConstPtr& msg, const sensor_msgs::CameraInfoConstPtr &cinfo)
 	{
-		Mat image = cv_bridge::toCvShare(msg, "bgr8")->image;
+		latency_.start();
+
+		// Detect on grayscale image: mono8 frames are shared without copying, color and YUV frames
+		// are converted once (detectMarkers would convert BGR image to grayscale anyway)
+		Mat image = cv_bridge::toCvShare(msg, "mono8")->image;
 
 		vector<int> ids;
-		vector<vector<cv::Point2f>> corners, rejected;
+		vector<vector<cv::Point2f>> corners;
 		vector<cv::Vec3d> rvecs, tvecs;
 		vector<cv::Point3f> obj_points;
 		geometry_msgs::TransformStamped snap_to;
 
-		// Detect markers
-		cv::aruco::detectMarkers(image, dictionary_, corners, ids, parameters_, rejected);
+		// Detect markers (or track them from the previous frame)
+		if (!tracking_ || tracker_.needDetection() || !tracker_.track(image, parameters_, corners, ids)) {
+			detect(image, msg->header.stamp, corners, ids);
+			if (tracking_) tracker_.reset(image, corners, ids);
+		}
+		latency_.stage("detect");
 
 		array_.header.stamp = msg->header.stamp;
 		array_.header.frame_id = msg->header.frame_id;
 		array_.markers.clear();
 
 		if (ids.size() != 0) {
-			parseCameraInfo(cinfo, camera_matrix_, dist_coeffs_);
+			if (intrinsics_.update(cinfo)) {
+				// distortion coefficients may be reallocated
+				camera_matrix_ = intrinsics_.matrix;
+				dist_coeffs_ = intrinsics_.dist;
+			}
 
 			// Estimate individual markers' poses
 			if (estimate_poses_) {
-				cv::aruco::estimatePoseSingleMarkers(corners, length_, camera_matrix_, dist_coeffs_,
-				                                     rvecs, tvecs);
-
-				// process length override, TODO: efficiency
-				if (!length_override_.empty()) {
-					for (unsigned int i = 0; i < ids.size(); i++) {
-						int id = ids[i];
-						auto item = length_override_.find(id);
-						if (item != length_override_.end()) { // found override
-							vector<cv::Vec3d> rvecs_current, tvecs_current;
-							vector<vector<cv::Point2f>> corners_current;
-							corners_current.push_back(corners[i]);
-							cv::aruco::estimatePoseSingleMarkers(corners_current, item->second,
-							                                     camera_matrix_, dist_coeffs_,
-										                         rvecs_current, tvecs_current);
-							rvecs[i] = rvecs_current[0];
-							tvecs[i] = tvecs_current[0];
-						}
-					}
-				}
+				estimatePoses(ids, corners, rvecs, tvecs);
+				latency_.stage("pose");
 
 				if (!known_tilt_.empty()) {
 					try {
-						snap_to = tf_buffer_.lookupTransform(msg->header.frame_id, known_tilt_,
-						                                     msg->header.stamp, ros::Duration(0.02));
+						snap_to = lookupTransform(tf_buffer_, msg->header.frame_id, known_tilt_, msg->header.stamp,
+						                          known_tilt_timeout_, known_tilt_max_age_);
 					} catch (const tf2::TransformException& e) {
 						ROS_WARN_THROTTLE(5, "aruco_detect: can't snap: %s", e.what());
 					}
+					latency_.stage("known_tilt");
 				}
 			}
 
 			array_.markers.reserve(ids.size());
+			transforms_.clear();
 			aruco_pose::Marker marker;
 			geometry_msgs::TransformStamped transform;
 			transform.header.stamp = msg->header.stamp;
@@ -183,22 +247,33 @@ private:
 					}
 
 					// TODO: check IDs are unique
-					if (send_tf_) {
+					// don't send transform if there is such static transform (e. g. from aruco_map)
+					if (send_tf_ && !isStaticMarker(ids[i])) {
 						transform.child_frame_id = getChildFrameId(ids[i]);
-
-						// check if such static transform exists
-						if (!tf_buffer_.canTransform(transform.header.frame_id, transform.child_frame_id, transform.header.stamp)) {
-							transform.transform.rotation = marker.pose.orientation;
-							fillTranslation(transform.transform.translation, tvecs[i]);
-							br_.sendTransform(transform);
-						}
+						transform.transform.rotation = marker.pose.orientation;
+						fillTranslation(transform.transform.translation, tvecs[i]);
+						transforms_.push_back(transform);
 					}
 				}
 				array_.markers.push_back(marker);
 			}
+
+			// send all markers' transforms in one message
+			if (!transforms_.empty()) {
+				br_.sendTransform(transforms_);
+			}
+			latency_.stage("tf");
 		}
 
 		markers_pub_.publish(array_);
+		latency_.stage("publish");
+		latency_.latency(msg->header.stamp);
+
+		// Hand off markers to aruco_map nodelets running in the fused mode
+		if (hasMarkersConsumers(getName())) {
+			callMarkersConsumers(getName(), msg, cinfo, array_.header, corners, ids);
+			latency_.stage("fused");
+		}
 
 		// Publish visualization markers
 		if (estimate_poses_ && vis_markers_pub_.getNumSubscribers() != 0) {
@@ -214,11 +289,13 @@ private:
 				               getMarkerLength(ids[i]), ids[i], i);
 
 			vis_markers_pub_.publish(vis_array_);
+			latency_.stage("visualization");
 		}
 
 		// Publish debug image
 		if (debug_pub_.getNumSubscribers() != 0) {
-			Mat debug = image.clone();
+			// BGR image is only needed for debug drawing
+			Mat debug = cv_bridge::toCvCopy(msg, "bgr8")->image;
 			cv::aruco::drawDetectedMarkers(debug, corners, ids); // draw markers
 			if (estimate_poses_)
 				for (unsigned int i = 0; i < ids.size(); i++)
@@ -231,6 +308,216 @@ private:
 			out_msg.encoding = sensor_msgs::image_encodings::BGR8;
 			out_msg.image = debug;
 			debug_pub_.publish(out_msg.toImageMsg());
+			latency_.stage("debug");
+		}
+
+		latency_.publish(diagnostics_pub_, getName());
+	}
+
+	void detect(const Mat& image, const ros::Time& stamp, vector<vector<cv::Point2f>>& corners, vector<int>& ids)
+	{
+		if (roi_detection_ && getRegions(image.size(), stamp, rois_)) {
+			detectInRegions(image, rois_, 0, corners, ids);
+		} else if (tiles_ > 1) {
+			// markers, which don't fit in the tiles overlap, are detected on the downscaled whole image
+			getTiles(image.size(), rois_);
+			detectInRegions(image, rois_, detection_scale_ * tiles_full_scale_, corners, ids);
+		} else {
+			detectImage(image, detection_scale_, corners, ids);
+		}
+	}
+
+	// Split the image into overlapping tiles
+	void getTiles(const cv::Size& size, vector<cv::Rect>& tiles) const
+	{
+		tiles.clear();
+		cv::Rect frame(cv::Point(0, 0), size);
+		int width = (size.width + tiles_ - 1) / tiles_;
+		int height = (size.height + tiles_ - 1) / tiles_;
+		for (int y = 0; y < tiles_; y++) {
+			for (int x = 0; x < tiles_; x++) {
+				cv::Rect tile(x * width - tiles_overlap_, y * height - tiles_overlap_,
+				              width + tiles_overlap_ * 2, height + tiles_overlap_ * 2);
+				tiles.push_back(tile & frame);
+			}
+		}
+	}
+
+	void detectImage(const Mat& image, double scale, vector<vector<cv::Point2f>>& corners, vector<int>& ids)
+	{
+		if (scale == 1) {
+			cv::aruco::detectMarkers(image, dictionary_, corners, ids, parameters_);
+			return;
+		}
+
+		// detect markers on the downscaled image
+		Mat scaled_image;
+		cv::resize(image, scaled_image, cv::Size(), scale, scale, cv::INTER_AREA);
+		cv::aruco::detectMarkers(scaled_image, dictionary_, corners, ids, scaled_parameters_);
+
+		// refine corners on the full resolution image
+		int win_size = std::max(parameters_->cornerRefinementWinSize, (int)std::ceil(2 / scale));
+		for (auto& marker_corners : corners) {
+			for (auto& corner : marker_corners) {
+				corner.x = (corner.x + 0.5) / scale - 0.5;
+				corner.y = (corner.y + 0.5) / scale - 0.5;
+			}
+			if (parameters_->cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX) {
+				cv::cornerSubPix(image, marker_corners, cv::Size(win_size, win_size), cv::Size(-1, -1),
+				                 cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+				                                  parameters_->cornerRefinementMaxIterations,
+				                                  parameters_->cornerRefinementMinAccuracy));
+			}
+		}
+	}
+
+	// Detect markers in image regions in parallel threads, not more than ~threads of them if set.
+	// Nonzero full_scale adds detection on the whole image with this scale, its markers come last.
+	void detectInRegions(const Mat& image, const vector<cv::Rect>& rois, double full_scale,
+	                     vector<vector<cv::Point2f>>& corners, vector<int>& ids)
+	{
+		int count = rois.size() + (full_scale > 0 ? 1 : 0);
+		regions_ids_.resize(count);
+		regions_corners_.resize(count);
+
+		cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; i++) {
+				if (i < (int)rois.size()) {
+					detectImage(image(rois[i]), detection_scale_, regions_corners_[i], regions_ids_[i]);
+				} else {
+					detectImage(image, full_scale, regions_corners_[i], regions_ids_[i]);
+				}
+			}
+		}, threads_ > 0 ? std::min<double>(threads_, count) : count);
+
+		corners.clear();
+		ids.clear();
+		for (int r = 0; r < count; r++) {
+			cv::Point offset = r < (int)rois.size() ? rois[r].tl() : cv::Point(0, 0);
+			for (unsigned int i = 0; i < regions_ids_[r].size(); i++) {
+				for (auto& corner : regions_corners_[r][i]) {
+					corner.x += offset.x;
+					corner.y += offset.y;
+				}
+				if (isDetected(regions_ids_[r][i], regions_corners_[r][i], ids, corners)) continue;
+				ids.push_back(regions_ids_[r][i]);
+				corners.push_back(regions_corners_[r][i]);
+			}
+		}
+	}
+
+	// Check if the marker is detected already in an overlapping region: markers with the same id
+	// are considered the same one, if their centers are closer than a half of the side
+	static bool isDetected(int id, const vector<cv::Point2f>& marker,
+	                       const vector<int>& ids, const vector<vector<cv::Point2f>>& corners)
+	{
+		cv::Point2f center = (marker[0] + marker[1] + marker[2] + marker[3]) * 0.25;
+		for (unsigned int i = 0; i < ids.size(); i++) {
+			if (ids[i] != id) continue;
+			cv::Point2f other = (corners[i][0] + corners[i][1] + corners[i][2] + corners[i][3]) * 0.25;
+			if (cv::norm(center - other) < cv::norm(corners[i][0] - corners[i][1]) / 2) return true;
+		}
+		return false;
+	}
+
+	void predictedCallback(const aruco_pose::MarkerArrayConstPtr& predicted)
+	{
+		std::lock_guard<std::mutex> lock(predicted_mutex_);
+		predicted_ = predicted;
+	}
+
+	// Get regions of markers predicted by aruco_map, returns false if full-frame detection is needed
+	bool getRegions(const cv::Size& size, const ros::Time& stamp, vector<cv::Rect>& rois)
+	{
+		if (++roi_frames_ >= roi_full_interval_) {
+			roi_frames_ = 0; // periodic full-frame detection to find markers out of predicted regions
+			return false;
+		}
+
+		aruco_pose::MarkerArrayConstPtr predicted;
+		{
+			std::lock_guard<std::mutex> lock(predicted_mutex_);
+			predicted = predicted_;
+		}
+		if (!predicted || predicted->markers.empty() || stamp - predicted->header.stamp > roi_timeout_) {
+			return false;
+		}
+
+		rois.clear();
+		cv::Rect frame(cv::Point(0, 0), size);
+		for (auto const& marker : predicted->markers) {
+			vector<cv::Point2f> marker_corners = {
+				cv::Point2f(marker.c1.x, marker.c1.y),
+				cv::Point2f(marker.c2.x, marker.c2.y),
+				cv::Point2f(marker.c3.x, marker.c3.y),
+				cv::Point2f(marker.c4.x, marker.c4.y)
+			};
+			cv::Rect rect = cv::boundingRect(marker_corners);
+			int margin = std::max(rect.width, rect.height) * roi_margin_ + 10;
+			rect.x -= margin;
+			rect.y -= margin;
+			rect.width += margin * 2;
+			rect.height += margin * 2;
+			rect &= frame;
+			if (rect.area() > 0) {
+				rois.push_back(rect);
+			}
+		}
+		if (rois.empty()) return false;
+
+		// merge overlapping regions, so each marker is detected in one region
+		bool merged = true;
+		while (merged) {
+			merged = false;
+			for (unsigned int i = 0; i < rois.size() && !merged; i++) {
+				for (unsigned int j = i + 1; j < rois.size() && !merged; j++) {
+					if ((rois[i] & rois[j]).area() > 0) {
+						rois[i] |= rois[j];
+						rois.erase(rois.begin() + j);
+						merged = true;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	void estimatePoses(const vector<int>& ids, const vector<vector<cv::Point2f>>& corners,
+	                   vector<cv::Vec3d>& rvecs, vector<cv::Vec3d>& tvecs)
+	{
+		if (length_override_.empty()) {
+			cv::aruco::estimatePoseSingleMarkers(corners, length_, camera_matrix_, dist_coeffs_, rvecs, tvecs);
+			return;
+		}
+
+		// group markers by length, so poses are estimated once per each length
+		length_groups_.clear();
+		for (unsigned int i = 0; i < ids.size(); i++) {
+			length_groups_[getMarkerLength(ids[i])].push_back(i);
+		}
+
+		if (length_groups_.size() == 1) { // all markers have the same length
+			cv::aruco::estimatePoseSingleMarkers(corners, length_groups_.begin()->first,
+			                                     camera_matrix_, dist_coeffs_, rvecs, tvecs);
+			return;
+		}
+
+		rvecs.resize(ids.size());
+		tvecs.resize(ids.size());
+		vector<vector<cv::Point2f>> group_corners;
+		vector<cv::Vec3d> group_rvecs, group_tvecs;
+
+		for (auto const& group : length_groups_) {
+			group_corners.clear();
+			for (int i : group.second) {
+				group_corners.push_back(corners[i]);
+			}
+			cv::aruco::estimatePoseSingleMarkers(group_corners, group.first, camera_matrix_, dist_coeffs_,
+			                                     group_rvecs, group_tvecs);
+			for (unsigned int j = 0; j < group.second.size(); j++) {
+				rvecs[group.second[j]] = group_rvecs[j];
+				tvecs[group.second[j]] = group_tvecs[j];
+			}
 		}
 	}
 
@@ -306,9 +593,38 @@ private:
 		vis_array_.markers.push_back(marker);
 	}
 
-	inline std::string getChildFrameId(int id) const
+	inline const std::string& getChildFrameId(int id)
+	{
+		auto item = child_frame_ids_.find(id);
+		if (item == child_frame_ids_.end()) {
+			item = child_frame_ids_.emplace(id, frame_id_prefix_ + std::to_string(id)).first;
+		}
+		return item->second;
+	}
+
+	// Remember markers, which have static transforms. The sets of all messages are merged: nodelets
+	// in one manager share the publisher name, and static frames never expire in TF buffers anyway.
+	void tfStaticCallback(const tf2_msgs::TFMessageConstPtr& msg)
+	{
+		std::lock_guard<std::mutex> lock(static_markers_mutex_);
+		for (auto const& transform : msg->transforms) {
+			std::string frame = transform.child_frame_id;
+			if (!frame.empty() && frame[0] == '/') frame.erase(0, 1);
+			if (frame.size() <= frame_id_prefix_.size() ||
+			    frame.compare(0, frame_id_prefix_.size(), frame_id_prefix_) != 0) continue;
+
+			std::string id = frame.substr(frame_id_prefix_.size());
+			auto digit = [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+			if (id.size() < 10 && std::all_of(id.begin(), id.end(), digit)) {
+				static_markers_.insert(std::stoi(id));
+			}
+		}
+	}
+
+	inline bool isStaticMarker(int id)
 	{
-		return frame_id_prefix_ + std::to_string(id);
+		std::lock_guard<std::mutex> lock(static_markers_mutex_);
+		return static_markers_.find(id) != static_markers_.end();
 	}
 
 	void readLengthOverride()
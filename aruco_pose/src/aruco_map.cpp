@@ -19,6 +19,11 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
 #include <ros/ros.h>
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
@@ -28,16 +33,17 @@
 #include <tf2_ros/buffer.h>
 #include <tf2_ros/transform_listener.h>
 #include <tf2_ros/transform_broadcaster.h>
-#include <tf2_ros/static_transform_broadcaster.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <message_filters/subscriber.h>
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/exact_time.h>
 #include <geometry_msgs/TransformStamped.h>
+#include <tf2_msgs/TFMessage.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <sensor_msgs/Image.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <std_srvs/Trigger.h>
 
 #include <aruco_pose/MarkerArray.h>
 #include <aruco_pose/Marker.h>
@@ -47,6 +53,10 @@
 
 #include "draw.h"
 #include "utils.h"
+#include "latency.h"
+#include "map_index.h"
+#include "map_file.h"
+#include "fused.h"
 
 using std::vector;
 using cv::Mat;
@@ -56,30 +66,83 @@ using aruco_pose::MarkerArray;
 
 typedef message_filters::sync_policies::ExactTime<Image, CameraInfo, MarkerArray> SyncPolicy;
 
+// Markers' static transforms of all the aruco_map nodelets of the process by nodelet name. They share
+// the latched /tf_static publication, which keeps only the last message, so each one publishes all of them.
+static std::map<std::string, vector<geometry_msgs::TransformStamped>> static_frames;
+static std::mutex static_frames_mutex;
+
+// Markers map, that is replaced as a whole on reloading
+struct Map
+{
+	cv::Ptr<cv::aruco::Board> board;
+	MarkerIndex index;
+	double max_length = 0, min_z = 0, max_z = 0, mean_z = 0;
+	vector<geometry_msgs::TransformStamped> markers_transforms;
+	visualization_msgs::MarkerArray vis_array;
+	uint64_t hash = 0; // map file hash, for the image cache
+};
+
 class ArucoMap : public nodelet::Nodelet {
 private:
 	ros::NodeHandle nh_, nh_priv_;
-	ros::Publisher img_pub_, pose_pub_, vis_markers_pub_;
+	ros::Publisher img_pub_, pose_pub_, vis_markers_pub_, predicted_pub_, diagnostics_pub_, static_tf_pub_;
 	image_transport::Publisher debug_pub_;
 	message_filters::Subscriber<Image> image_sub_;
 	message_filters::Subscriber<CameraInfo> info_sub_;
 	message_filters::Subscriber<MarkerArray> markers_sub_;
 	boost::shared_ptr<message_filters::Synchronizer<SyncPolicy> > sync_;
-	cv::Ptr<cv::aruco::Board> board_;
+	ros::Subscriber markers_only_sub_, info_cache_sub_, debug_image_sub_;
+	sensor_msgs::CameraInfoConstPtr cinfo_;
+	std::deque<sensor_msgs::ImageConstPtr> images_;
+	std::mutex cinfo_mutex_, images_mutex_, debug_mutex_;
+	ros::ServiceServer reload_srv_;
+	ros::Timer watch_timer_;
+	std::shared_ptr<const Map> current_map_; // accessed with std::atomic_load/atomic_store
+	std::mutex reload_mutex_, image_mutex_;
+	bool image_published_ = false;
+	int64_t map_mtime_ = 0; // nanoseconds, guarded by reload_mutex_ as map_size_
+	off_t map_size_ = 0;
+	int dictionary_;
+	vector<cv::Point3f> obj_points_;
+	vector<cv::Point2f> img_points_;
+	vector<int> candidates_;
+	vector<char> inliers_, best_inliers_;
+	int robust_inliers_ = 0, robust_count_ = 0;
+	double robust_error_ = 0; // mean reprojection error of the inliers
+	vector<cv::Point2f> projected_;
+	vector<vector<cv::Point2f>> outliers_;
+	cv::Vec3d prev_rvec_, prev_tvec_;
+	bool has_prev_pose_ = false;
+	ros::Time prev_stamp_;
 	Mat camera_matrix_, dist_coeffs_;
+	CameraIntrinsics intrinsics_;
 	geometry_msgs::TransformStamped transform_;
 	geometry_msgs::PoseWithCovarianceStamped pose_;
-	vector<geometry_msgs::TransformStamped> markers_transforms_;
 	tf2_ros::TransformBroadcaster br_;
-	tf2_ros::StaticTransformBroadcaster static_br_;
 	tf2_ros::Buffer tf_buffer_;
 	tf2_ros::TransformListener tf_listener_{tf_buffer_};
-	visualization_msgs::MarkerArray vis_array_;
-	std::string known_tilt_, map_, markers_frame_, markers_parent_frame_;
+	aruco_pose::MarkerArray predicted_;
+	vector<cv::Point3f> predicted_obj_points_;
+	vector<cv::Point2f> predicted_img_points_;
+	std::string known_tilt_, map_, markers_frame_, markers_parent_frame_, image_cache_, fused_detector_;
+	ros::Duration known_tilt_timeout_, known_tilt_max_age_;
 	int image_width_, image_height_, image_margin_;
-	bool auto_flip_;
+	bool auto_flip_, robust_, warm_start_, sync_image_;
+	double robust_threshold_, covariance_min_error_, warm_start_max_error_;
+	ros::Duration warm_start_max_gap_;
+	int robust_iterations_;
+	LatencyStats latency_;
 
 public:
+	~ArucoMap()
+	{
+		if (!fused_detector_.empty()) {
+			unregisterMarkersConsumer(fused_detector_, getName());
+		}
+		std::lock_guard<std::mutex> lock(static_frames_mutex);
+		static_frames.erase(getName());
+	}
+
 	virtual void onInit()
 	{
 		nh_ = getNodeHandle();
@@ -88,67 +151,166 @@ public:
 		image_transport::ImageTransport it_priv(nh_priv_);
 
 		// TODO: why image_transport doesn't work here?
-		img_pub_ = nh_priv_.advertise<sensor_msgs::Image>("image", 1, true);
+		// the image is rendered lazily on the first subscription
+		img_pub_ = nh_priv_.advertise<sensor_msgs::Image>("image", 1,
+		           boost::bind(&ArucoMap::imageConnectCallback, this, _1),
+		           ros::SubscriberStatusCallback(), ros::VoidConstPtr(), true);
 
-		board_ = cv::makePtr<cv::aruco::Board>();
-		board_->dictionary = cv::aruco::getPredefinedDictionary(
-			                 static_cast<cv::aruco::PREDEFINED_DICTIONARY_NAME>(nh_priv_.param("dictionary", 2)));
-		camera_matrix_ = cv::Mat::zeros(3, 3, CV_64F);
-		dist_coeffs_ = cv::Mat::zeros(8, 1, CV_64F);
+		dictionary_ = nh_priv_.param("dictionary", 2);
+		camera_matrix_ = intrinsics_.matrix;
+		dist_coeffs_ = intrinsics_.dist;
 
-		std::string type, map;
+		std::string type;
 		nh_priv_.param<std::string>("type", type, "map");
 		nh_priv_.param<std::string>("frame_id", transform_.child_frame_id, "aruco_map");
 		nh_priv_.param<std::string>("known_tilt", known_tilt_, "");
+		known_tilt_timeout_ = ros::Duration(nh_priv_.param("known_tilt_timeout", 0.02));
+		known_tilt_max_age_ = ros::Duration(nh_priv_.param("known_tilt_max_age", 0.0));
 		nh_priv_.param("auto_flip", auto_flip_, false);
 		nh_priv_.param("image_width", image_width_, 2000);
 		nh_priv_.param("image_height", image_height_, 2000);
 		nh_priv_.param("image_margin", image_margin_, 200);
+		nh_priv_.param<std::string>("image_cache", image_cache_, "");
 		nh_priv_.param<std::string>("markers/frame_id", markers_parent_frame_, transform_.child_frame_id);
 		nh_priv_.param<std::string>("markers/child_frame_id_prefix", markers_frame_, "");
+		nh_priv_.param("diagnostics", latency_.enabled, false);
+		nh_priv_.param("robust", robust_, false);
+		nh_priv_.param("robust_threshold", robust_threshold_, 3.0);
+		nh_priv_.param("robust_iterations", robust_iterations_, 10);
+		nh_priv_.param("covariance_min_error", covariance_min_error_, 0.5);
+		nh_priv_.param("warm_start", warm_start_, false);
+		nh_priv_.param("warm_start_max_error", warm_start_max_error_, 2.0);
+		warm_start_max_gap_ = ros::Duration(nh_priv_.param("warm_start_max_gap", 0.5));
+		nh_priv_.param("sync_image", sync_image_, true);
+		nh_priv_.param<std::string>("fused_detector", fused_detector_, "");
 
 		// createStripLine();
 
+		auto map = createMap();
 		if (type == "map") {
-			param(nh_priv_, "map", map);
-			loadMap(map);
+			param(nh_priv_, "map", map_);
+			try {
+				loadMap(map_, *map);
+			} catch (const std::runtime_error& e) {
+				ROS_FATAL("aruco_map: %s", e.what());
+				ros::shutdown();
+				throw;
+			}
 		} else if (type == "gridboard") {
-			createGridBoard();
+			createGridBoard(*map);
 		} else {
 			ROS_FATAL("aruco_map: unknown type: %s", type.c_str());
 			ros::shutdown();
 		}
+		std::atomic_store(&current_map_, std::shared_ptr<const Map>(map));
 
 		pose_pub_ = nh_priv_.advertise<geometry_msgs::PoseWithCovarianceStamped>("pose", 1);
+		// not StaticTransformBroadcaster, as it keeps all the transforms ever sent
+		static_tf_pub_ = nh_.advertise<tf2_msgs::TFMessage>("/tf_static", 100, true);
 		vis_markers_pub_ = nh_priv_.advertise<visualization_msgs::MarkerArray>("visualization", 1, true);
-		debug_pub_ = it_priv.advertise("debug", 1);
+		if (sync_image_ || !fused_detector_.empty()) {
+			debug_pub_ = it_priv.advertise("debug", 1);
+		} else {
+			// subscribe to images only when the debug image is needed
+			debug_pub_ = it_priv.advertise("debug", 1,
+			             boost::bind(&ArucoMap::debugConnectCallback, this),
+			             boost::bind(&ArucoMap::debugConnectCallback, this));
+		}
+		predicted_pub_ = nh_priv_.advertise<aruco_pose::MarkerArray>("predicted_markers", 1);
+		if (latency_.enabled) {
+			diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+		}
 
-		image_sub_.subscribe(nh_, "image_raw", 1);
-		info_sub_.subscribe(nh_, "camera_info", 1);
-		markers_sub_.subscribe(nh_, "markers", 1);
+		if (!fused_detector_.empty()) {
+			// get markers directly from aruco_detect nodelet in the same process
+			fused_detector_ = nh_.resolveName(fused_detector_, false);
+			registerMarkersConsumer(fused_detector_, getName(),
+			                        boost::bind(&ArucoMap::process, this, _1, _2, _3, _4, _5));
+			ROS_INFO("aruco_map: getting markers from %s directly", fused_detector_.c_str());
+		} else if (sync_image_) {
+			image_sub_.subscribe(nh_, "image_raw", 1);
+			info_sub_.subscribe(nh_, "camera_info", 1);
+			markers_sub_.subscribe(nh_, "markers", 1);
+
+			sync_.reset(new message_filters::Synchronizer<SyncPolicy>(SyncPolicy(10), image_sub_, info_sub_, markers_sub_));
+			sync_->registerCallback(boost::bind(&ArucoMap::callback, this, _1, _2, _3));
+		} else {
+			info_cache_sub_ = nh_.subscribe("camera_info", 1, &ArucoMap::cameraInfoCallback, this);
+			markers_only_sub_ = nh_.subscribe("markers", 1, &ArucoMap::markersCallback, this);
+		}
 
-		sync_.reset(new message_filters::Synchronizer<SyncPolicy>(SyncPolicy(10), image_sub_, info_sub_, markers_sub_));
-		sync_->registerCallback(boost::bind(&ArucoMap::callback, this, _1, _2, _3));
+		publishMarkersFrames(*map);
+		updateMapImage();
+		vis_markers_pub_.publish(map->vis_array);
 
-		publishMarkersFrames();
-		publishMapImage();
-		vis_markers_pub_.publish(vis_array_);
+		if (type == "map") {
+			reload_srv_ = nh_priv_.advertiseService("reload", &ArucoMap::reloadCallback, this);
+			double watch_interval = nh_priv_.param("watch_interval", 0.0);
+			if (watch_interval > 0) {
+				watch_timer_ = nh_.createTimer(ros::Duration(watch_interval), &ArucoMap::watchCallback, this);
+			}
+		}
 
 		ROS_INFO("aruco_map: ready");
 	}
 
+	void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& cinfo)
+	{
+		std::lock_guard<std::mutex> lock(cinfo_mutex_);
+		cinfo_ = cinfo;
+	}
+
+	void debugConnectCallback()
+	{
+		std::lock_guard<std::mutex> debug_lock(debug_mutex_);
+		if (debug_pub_.getNumSubscribers() > 0 && !debug_image_sub_) {
+			debug_image_sub_ = nh_.subscribe("image_raw", 1, &ArucoMap::imageCallback, this);
+		} else if (debug_pub_.getNumSubscribers() == 0 && debug_image_sub_) {
+			debug_image_sub_.shutdown();
+			std::lock_guard<std::mutex> lock(images_mutex_);
+			images_.clear();
+		}
+	}
+
+	void imageCallback(const sensor_msgs::ImageConstPtr& image)
+	{
+		std::lock_guard<std::mutex> lock(images_mutex_);
+		images_.push_back(image);
+		if (images_.size() > 5) images_.pop_front();
+	}
+
+	// Markers paired with the last camera info and the image with the same stamp, if available
+	void markersCallback(const aruco_pose::MarkerArrayConstPtr& markers)
+	{
+		sensor_msgs::CameraInfoConstPtr cinfo;
+		sensor_msgs::ImageConstPtr image;
+		{
+			std::lock_guard<std::mutex> lock(cinfo_mutex_);
+			cinfo = cinfo_;
+		}
+		if (!cinfo) {
+			ROS_WARN_THROTTLE(1, "aruco_map: no camera info received yet");
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(images_mutex_);
+			for (auto const& img : images_) {
+				if (img->header.stamp == markers->header.stamp) {
+					image = img;
+					break;
+				}
+			}
+		}
+		callback(image, cinfo, markers);
+	}
+
 	void callback(const sensor_msgs::ImageConstPtr& image,
 	              const sensor_msgs::CameraInfoConstPtr& cinfo,
 	              const aruco_pose::MarkerArrayConstPtr& markers)
 	{
-		int valid = 0;
 		int count = markers->markers.size();
 		std::vector<int> ids;
 		std::vector<std::vector<cv::Point2f>> corners;
-		cv::Vec3d rvec, tvec;
-
-		parseCameraInfo(cinfo, camera_matrix_, dist_coeffs_);
-		if (markers->markers.empty()) goto publish_debug;
 
 		ids.reserve(count);
 		corners.reserve(count);
@@ -164,38 +326,73 @@ public:
 			corners.push_back(marker_corners);
 		}
 
+		process(image, cinfo, markers->header, corners, ids);
+	}
+
+	// Estimate the map pose from detected markers
+	void process(const sensor_msgs::ImageConstPtr& image,
+	             const sensor_msgs::CameraInfoConstPtr& cinfo,
+	             const std_msgs::Header& header,
+	             const vector<vector<cv::Point2f>>& corners,
+	             const vector<int>& ids)
+	{
+		int valid = 0;
+		cv::Vec3d rvec, tvec;
+		Mat obj_points, img_points;
+		auto map = std::atomic_load(&current_map_); // the map may be swapped by reloading
+
+		latency_.start();
+		if (intrinsics_.update(cinfo)) {
+			// distortion coefficients may be reallocated
+			camera_matrix_ = intrinsics_.matrix;
+			dist_coeffs_ = intrinsics_.dist;
+		}
+		outliers_.clear();
+		robust_count_ = 0;
+		robust_error_ = 0;
+		if (!ids.empty()) {
+			getObjectAndImagePoints(*map, corners, ids, obj_points, img_points);
+		}
+		latency_.stage("points"); // finish the stage before any jump, so the debug stage is measured alone
+		if (obj_points.empty()) goto publish_debug;
+
+		if (robust_) {
+			rejectOutliers(obj_points, img_points);
+			latency_.stage("robust");
+		}
+
 		if (known_tilt_.empty()) {
 			// simple estimation
-			valid = cv::aruco::estimatePoseBoard(corners, ids, board_, camera_matrix_, dist_coeffs_,
-			                                     rvec, tvec, false);
+			valid = estimatePose(obj_points, img_points, header.stamp, cv::Vec3d(0, 0, 0), rvec, tvec);
+			latency_.stage("estimate");
 			if (!valid) goto publish_debug;
 
-			transform_.header.stamp = markers->header.stamp;
-			transform_.header.frame_id = markers->header.frame_id;
+			transform_.header.stamp = header.stamp;
+			transform_.header.frame_id = header.frame_id;
 			pose_.header = transform_.header;
 			fillPose(pose_.pose.pose, rvec, tvec);
 			fillTransform(transform_.transform, rvec, tvec);
 
 		} else {
-			Mat obj_points, img_points;
 			// estimation with "snapping"
-			cv::aruco::getBoardObjectAndImagePoints(board_, corners, ids, obj_points, img_points);
-			if (obj_points.empty()) goto publish_debug;
-
 			double center_x = 0, center_y = 0, center_z = 0;
 			alignObjPointsToCenter(obj_points, center_x, center_y, center_z);
 
-			valid = solvePnP(obj_points, img_points, camera_matrix_, dist_coeffs_, rvec, tvec, false);
+			valid = estimatePose(obj_points, img_points, header.stamp,
+			                     cv::Vec3d(center_x, center_y, center_z), rvec, tvec);
+			latency_.stage("estimate");
 			if (!valid) goto publish_debug;
 
 			fillTransform(transform_.transform, rvec, tvec);
 			try {
-				geometry_msgs::TransformStamped snap_to = tf_buffer_.lookupTransform(markers->header.frame_id,
-				                                          known_tilt_, markers->header.stamp, ros::Duration(0.02));
+				geometry_msgs::TransformStamped snap_to = lookupTransform(tf_buffer_, header.frame_id,
+				                                          known_tilt_, header.stamp,
+				                                          known_tilt_timeout_, known_tilt_max_age_);
 				snapOrientation(transform_.transform.rotation, snap_to.transform.rotation, auto_flip_);
 			} catch (const tf2::TransformException& e) {
 				ROS_WARN_THROTTLE(1, "aruco_map: can't snap: %s", e.what());
 			}
+			latency_.stage("known_tilt");
 
 			geometry_msgs::TransformStamped shift;
 			shift.transform.translation.x = -center_x;
@@ -203,28 +400,47 @@ public:
 			shift.transform.translation.z = -center_z;
 			shift.transform.rotation.w = 1;
 			tf2::doTransform(shift, transform_, transform_);
+			obj_points += cv::Scalar(center_x, center_y, center_z); // restore object points
 
 			// for debug topic
 			tvec[0] = transform_.transform.translation.x;
 			tvec[1] = transform_.transform.translation.y;
 			tvec[2] = transform_.transform.translation.z;
 
-			transform_.header.stamp = markers->header.stamp;
-			transform_.header.frame_id = markers->header.frame_id;
+			transform_.header.stamp = header.stamp;
+			transform_.header.frame_id = header.frame_id;
 			pose_.header = transform_.header;
 			transformToPose(transform_.transform, pose_.pose.pose);
 		}
 
+		// remember the pose as a hypothesis for the next frame
+		transformToRvecTvec(transform_.transform, prev_rvec_, prev_tvec_);
+		prev_stamp_ = header.stamp;
+		has_prev_pose_ = true;
+		fillCovariance(prev_rvec_, prev_tvec_, robust_error_, pose_.pose.covariance);
+		latency_.stage("covariance");
+
 		if (!transform_.child_frame_id.empty()) {
 			br_.sendTransform(transform_);
 		}
 		pose_pub_.publish(pose_);
+		latency_.stage("publish");
+		latency_.latency(header.stamp);
+		publishPredictedMarkers(*map, *cinfo);
+		latency_.stage("predicted_markers");
 
 publish_debug:
 		// publish debug image (even if no map detected)
-		if (debug_pub_.getNumSubscribers() > 0) {
+		if (image && debug_pub_.getNumSubscribers() > 0) {
 			Mat mat = cv_bridge::toCvCopy(image, "bgr8")->image; // copy image as we're planning to modify it
 			cv::aruco::drawDetectedMarkers(mat, corners, ids); // draw detected markers
+			if (!outliers_.empty()) {
+				cv::aruco::drawDetectedMarkers(mat, outliers_, cv::noArray(), cv::Scalar(0, 0, 255)); // rejected markers
+			}
+			if (robust_count_ > 0) {
+				std::string text = "inliers: " + std::to_string(robust_inliers_) + "/" + std::to_string(robust_count_);
+				cv::putText(mat, text, cv::Point(10, 25), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+			}
 			if (valid) {
 				_drawAxis(mat, camera_matrix_, dist_coeffs_, rvec, tvec, 1.0); // draw board axis
 			}
@@ -234,7 +450,311 @@ publish_debug:
 			out_msg.encoding = sensor_msgs::image_encodings::BGR8;
 			out_msg.image = mat;
 			debug_pub_.publish(out_msg.toImageMsg());
+			latency_.stage("debug");
+		}
+
+		latency_.publish(diagnostics_pub_, getName());
+	}
+
+	// Publish markers' image corners predicted for the next frame from the current map pose
+	void publishPredictedMarkers(const Map& map, const sensor_msgs::CameraInfo& cinfo)
+	{
+		if (predicted_pub_.getNumSubscribers() == 0) return;
+
+		cv::Vec3d rvec, tvec;
+		transformToRvecTvec(transform_.transform, rvec, tvec);
+		cv::Matx33d rmat;
+		cv::Rodrigues(rvec, rmat);
+
+		// project markers that are in front of the camera
+		getCandidateMarkers(map, rmat, tvec, cinfo, candidates_);
+		predicted_obj_points_.clear();
+		vector<int> indices;
+		for (int i : candidates_) {
+			bool visible = true;
+			for (auto const& p : map.board->objPoints[i]) {
+				if ((rmat * cv::Vec3d(p.x, p.y, p.z) + tvec)[2] <= 0) {
+					visible = false;
+					break;
+				}
+			}
+			if (!visible) continue;
+			indices.push_back(i);
+			predicted_obj_points_.insert(predicted_obj_points_.end(),
+			                             map.board->objPoints[i].begin(), map.board->objPoints[i].end());
+		}
+
+		predicted_.header = transform_.header;
+		predicted_.markers.clear();
+
+		if (!predicted_obj_points_.empty()) {
+			cv::projectPoints(predicted_obj_points_, rvec, tvec, camera_matrix_, dist_coeffs_,
+			                  predicted_img_points_);
+		}
+
+		cv::Rect frame(0, 0, cinfo.width, cinfo.height);
+		aruco_pose::Marker marker;
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			auto begin = predicted_img_points_.begin() + i * 4;
+			vector<cv::Point2f> corners(begin, begin + 4);
+			if ((cv::boundingRect(corners) & frame).area() == 0) continue; // out of the image
+
+			auto const& obj = map.board->objPoints[indices[i]];
+			marker.id = map.board->ids[indices[i]];
+			marker.length = cv::norm(obj[1] - obj[0]);
+			marker.c1.x = corners[0].x;
+			marker.c1.y = corners[0].y;
+			marker.c2.x = corners[1].x;
+			marker.c2.y = corners[1].y;
+			marker.c3.x = corners[2].x;
+			marker.c3.y = corners[2].y;
+			marker.c4.x = corners[3].x;
+			marker.c4.y = corners[3].y;
+			predicted_.markers.push_back(marker);
+		}
+
+		predicted_pub_.publish(predicted_);
+	}
+
+	// Find markers that may be visible on the image, assuming the map is close to the horizontal plane
+	// at its markers mean height; the height spread is added to the query radius
+	void getCandidateMarkers(const Map& map, const cv::Matx33d& rmat, const cv::Vec3d& tvec,
+	                         const sensor_msgs::CameraInfo& cinfo, vector<int>& indices) const
+	{
+		cv::Vec3d camera = -(rmat.t() * tvec); // camera position in map frame
+		cv::Vec3d axis = rmat.t() * cv::Vec3d(0, 0, 1); // camera optical axis in map frame
+		double focal = camera_matrix_.at<double>(0, 0);
+		double fov = 0; // max angle between optical axis and image corners' rays
+		for (double u : {0.0, (double)cinfo.width})
+			for (double v : {0.0, (double)cinfo.height}) {
+				cv::Vec3d ray = intrinsics_.matrix_inv * cv::Vec3d(u, v, 1);
+				fov = std::max(fov, std::atan(std::hypot(ray[0], ray[1]) / ray[2]));
+			}
+		double tilt = std::acos(std::min(std::abs(axis[2]), 1.0));
+		double height = camera[2] - map.mean_z; // camera height above the map plane
+		double dist = axis[2] == 0 ? -1 : -height / axis[2]; // distance to the map plane along the axis
+
+		if (focal > 0 && dist > 0 && tilt + fov < M_PI / 2 * 0.9) {
+			// query around the point, where optical axis crosses the map plane
+			double far = std::tan(tilt + fov);
+			double radius = std::abs(height) * (far - std::tan(tilt)) + (map.max_z - map.min_z) * far + map.max_length;
+			cv::Point3f center(camera[0] + axis[0] * dist, camera[1] + axis[1] * dist, map.mean_z);
+			map.index.query(center, radius, indices);
+		} else {
+			// camera looks too far aside from the map plane, check all the markers
+			indices.resize(map.board->ids.size());
+			for (unsigned int i = 0; i < indices.size(); i++) {
+				indices[i] = i;
+			}
+		}
+	}
+
+	// Get object points and image points of detected markers, that are in the map
+	void getObjectAndImagePoints(const Map& map, const vector<vector<cv::Point2f>>& corners, const vector<int>& ids,
+	                             Mat& obj_points, Mat& img_points)
+	{
+		obj_points_.clear();
+		img_points_.clear();
+		for (unsigned int i = 0; i < ids.size(); i++) {
+			int index = map.index.find(ids[i]);
+			if (index < 0) continue;
+			obj_points_.insert(obj_points_.end(), map.board->objPoints[index].begin(), map.board->objPoints[index].end());
+			img_points_.insert(img_points_.end(), corners[i].begin(), corners[i].end());
 		}
+		// wrap the vectors without copying
+		obj_points = Mat(obj_points_);
+		img_points = Mat(img_points_);
+	}
+
+	// Solve PnP starting from the previous pose, if it's recent enough and the result reprojects well,
+	// otherwise solve from scratch. Object points may be shifted by center.
+	bool estimatePose(const Mat& obj_points, const Mat& img_points, const ros::Time& stamp,
+	                  const cv::Vec3d& center, cv::Vec3d& rvec, cv::Vec3d& tvec)
+	{
+		if (warm_start_ && has_prev_pose_ && stamp >= prev_stamp_ && stamp - prev_stamp_ <= warm_start_max_gap_) {
+			cv::Matx33d rmat;
+			cv::Rodrigues(prev_rvec_, rmat);
+			rvec = prev_rvec_;
+			tvec = prev_tvec_ + rmat * center;
+			if (solvePnP(obj_points, img_points, camera_matrix_, dist_coeffs_, rvec, tvec, true) &&
+			    reprojectionError(obj_points, rvec, tvec) <= warm_start_max_error_) {
+				return true;
+			}
+			ROS_DEBUG("aruco_map: warm start failed, solving from scratch");
+		}
+		return solvePnP(obj_points, img_points, camera_matrix_, dist_coeffs_, rvec, tvec, false);
+	}
+
+	// Mean reprojection error of the object points, image points are in img_points_
+	double reprojectionError(const Mat& obj_points, const cv::Vec3d& rvec, const cv::Vec3d& tvec)
+	{
+		cv::projectPoints(obj_points, rvec, tvec, camera_matrix_, dist_coeffs_, projected_);
+		double sum = 0;
+		for (unsigned int i = 0; i < projected_.size(); i++) {
+			sum += cv::norm(projected_[i] - img_points_[i]);
+		}
+		return projected_.empty() ? 0 : sum / projected_.size();
+	}
+
+	// Reject markers, that don't agree with the best pose hypothesis. Hypotheses are the previous pose
+	// and single markers' poses (larger markers first), the best one is refined on its inliers.
+	void rejectOutliers(Mat& obj_points, Mat& img_points)
+	{
+		int count = obj_points_.size() / 4;
+		if (count < 3) return; // not enough markers to vote
+
+		vector<int> order(count);
+		vector<double> areas(count);
+		for (int i = 0; i < count; i++) {
+			order[i] = i;
+			areas[i] = cv::contourArea(vector<cv::Point2f>(img_points_.begin() + i * 4, img_points_.begin() + i * 4 + 4));
+		}
+		std::sort(order.begin(), order.end(), [&areas](int a, int b) { return areas[a] > areas[b]; });
+
+		cv::Vec3d rvec, tvec, best_rvec, best_tvec;
+		int best_count = 0;
+		double error, best_error = 0;
+
+		for (int h = -1; h < std::min(count, robust_iterations_); h++) {
+			if (h == -1) {
+				if (!has_prev_pose_) continue;
+				rvec = prev_rvec_;
+				tvec = prev_tvec_;
+			} else {
+				int i = order[h];
+				if (best_count > 0 && best_inliers_[i]) continue; // would give a similar hypothesis
+				vector<cv::Point3f> obj(obj_points_.begin() + i * 4, obj_points_.begin() + i * 4 + 4);
+				vector<cv::Point2f> img(img_points_.begin() + i * 4, img_points_.begin() + i * 4 + 4);
+				if (!solvePnP(obj, img, camera_matrix_, dist_coeffs_, rvec, tvec, false)) continue;
+			}
+
+			int inliers = countInliers(rvec, tvec, inliers_, error);
+			if (inliers > best_count || (inliers == best_count && error < best_error)) {
+				best_count = inliers;
+				best_error = error;
+				best_rvec = rvec;
+				best_tvec = tvec;
+				best_inliers_.swap(inliers_);
+			}
+			if (best_count == count) break;
+		}
+
+		robust_count_ = count;
+		robust_inliers_ = count;
+		if (best_count < 2) return; // no consensus, keep all the markers
+
+		// local optimization: refine the best hypothesis on its inliers
+		if (best_count < count) {
+			vector<cv::Point3f> obj;
+			vector<cv::Point2f> img;
+			for (int i = 0; i < count; i++) {
+				if (!best_inliers_[i]) continue;
+				obj.insert(obj.end(), obj_points_.begin() + i * 4, obj_points_.begin() + i * 4 + 4);
+				img.insert(img.end(), img_points_.begin() + i * 4, img_points_.begin() + i * 4 + 4);
+			}
+			rvec = best_rvec;
+			tvec = best_tvec;
+			if (solvePnP(obj, img, camera_matrix_, dist_coeffs_, rvec, tvec, true)) {
+				int inliers = countInliers(rvec, tvec, inliers_, error);
+				if (inliers >= best_count) {
+					best_count = inliers;
+					best_error = error;
+					best_inliers_.swap(inliers_);
+				}
+			}
+		}
+
+		// remove outliers
+		int j = 0;
+		for (int i = 0; i < count; i++) {
+			if (!best_inliers_[i]) {
+				vector<cv::Point2f> outlier(img_points_.begin() + i * 4, img_points_.begin() + i * 4 + 4);
+				outliers_.push_back(outlier);
+				continue;
+			}
+			std::copy(obj_points_.begin() + i * 4, obj_points_.begin() + i * 4 + 4, obj_points_.begin() + j * 4);
+			std::copy(img_points_.begin() + i * 4, img_points_.begin() + i * 4 + 4, img_points_.begin() + j * 4);
+			j++;
+		}
+		obj_points_.resize(j * 4);
+		img_points_.resize(j * 4);
+		obj_points = Mat(obj_points_);
+		img_points = Mat(img_points_);
+
+		robust_inliers_ = best_count;
+		robust_error_ = best_error;
+		ROS_DEBUG("aruco_map: %d of %d markers are inliers, mean reprojection error %.2f px",
+		          best_count, count, best_error);
+	}
+
+	// Count markers with mean corners reprojection error below the threshold, return their mean error
+	int countInliers(const cv::Vec3d& rvec, const cv::Vec3d& tvec, vector<char>& inliers, double& error)
+	{
+		int count = obj_points_.size() / 4;
+		cv::projectPoints(obj_points_, rvec, tvec, camera_matrix_, dist_coeffs_, projected_);
+		inliers.assign(count, 0);
+		int result = 0;
+		error = 0;
+		for (int i = 0; i < count; i++) {
+			double marker_error = 0;
+			for (int j = i * 4; j < i * 4 + 4; j++) {
+				marker_error += cv::norm(projected_[j] - img_points_[j]) / 4;
+			}
+			if (marker_error < robust_threshold_) {
+				inliers[i] = 1;
+				error += marker_error;
+				result++;
+			}
+		}
+		if (result > 0) error /= result;
+		return result;
+	}
+
+	// Estimate the pose covariance from the reprojection Jacobian and residuals,
+	// so it grows with fewer, smaller and farther markers. Reprojection error of the outliers rejection
+	// (zero if not used) and ~covariance_min_error are the lower bounds for the residuals.
+	void fillCovariance(const cv::Vec3d& rvec, const cv::Vec3d& tvec, double error,
+	                    boost::array<double, 36>& covariance)
+	{
+		Mat jacobian;
+		cv::projectPoints(obj_points_, rvec, tvec, camera_matrix_, dist_coeffs_, projected_, jacobian);
+
+		// reprojection error variance
+		double sum = 0;
+		int count = projected_.size();
+		for (int i = 0; i < count; i++) {
+			cv::Point2f d = projected_[i] - img_points_[i];
+			sum += d.x * d.x + d.y * d.y;
+		}
+		int dof = count * 2 - 6;
+		double min_error = std::max(covariance_min_error_, error);
+		double variance = std::max(dof > 0 ? sum / dof : 0, min_error * min_error);
+
+		// covariance of rvec and tvec
+		Mat j = jacobian.colRange(0, 6);
+		cv::Matx66d jtj = Mat(j.t() * j);
+		cv::Matx66d cov = jtj.inv(cv::DECOMP_SVD) * variance;
+
+		// convert rvec covariance to rotation angles covariance using left Jacobian of SO(3)
+		double theta = cv::norm(rvec);
+		cv::Matx33d k(0, -rvec[2], rvec[1],
+		              rvec[2], 0, -rvec[0],
+		              -rvec[1], rvec[0], 0);
+		cv::Matx33d jl = cv::Matx33d::eye();
+		if (theta > 1e-9) {
+			jl += k * ((1 - cos(theta)) / (theta * theta)) + k * k * ((theta - sin(theta)) / (theta * theta * theta));
+		}
+
+		// reorder to x, y, z, rotation about x, y, z
+		cv::Matx66d m = cv::Matx66d::zeros();
+		for (int r = 0; r < 3; r++) {
+			m(r, r + 3) = 1;
+			for (int c = 0; c < 3; c++) {
+				m(r + 3, c) = jl(r, c);
+			}
+		}
+		cov = m * cov * m.t();
+		std::copy(cov.val, cov.val + 36, covariance.begin());
 	}
 
 	void alignObjPointsToCenter(Mat &obj_points, double &center_x, double &center_y, double &center_z) const
@@ -261,73 +781,138 @@ publish_debug:
 		}
 	}
 
-	void loadMap(std::string filename)
+	std::shared_ptr<Map> createMap() const
 	{
-		std::ifstream f(filename);
-		std::string line;
+		auto map = std::make_shared<Map>();
+		map->board = cv::makePtr<cv::aruco::Board>();
+		map->board->dictionary = cv::aruco::getPredefinedDictionary(
+			static_cast<cv::aruco::PREDEFINED_DICTIONARY_NAME>(dictionary_));
+		return map;
+	}
 
-		if (!f.good()) {
-			ROS_FATAL("aruco_map: %s - %s", strerror(errno), filename.c_str());
-			ros::shutdown();
+	// Load map file into the map; throws std::runtime_error on errors
+	void loadMap(const std::string& filename, Map& map)
+	{
+		fileState(filename, map_mtime_, map_size_);
+		if (!image_cache_.empty()) {
+			map.hash = hashFile(filename);
 		}
 
-		while (std::getline(f, line)) {
-			int id;
-			double length, x, y, z, yaw, pitch, roll;
+		if (isCompiledMap(filename)) {
+			loadCompiledMap(filename, map);
+			return;
+		}
 
-			std::istringstream s(line);
+		std::vector<MapMarker> markers;
+		readMap(filename, markers);
+		for (auto const& marker : markers) {
+			addMarker(map, marker.id, marker.length, marker.x, marker.y, marker.z,
+			          marker.yaw, marker.pitch, marker.roll);
+		}
 
-			// Read first character to see whether it's a comment
-			char first = 0;
-			if (!(s >> first)) {
-				// No non-whitespace characters, must be a blank line
-				continue;
-			}
+		ROS_INFO("aruco_map: loading %s complete (%d markers)", filename.c_str(), static_cast<int>(map.board->ids.size()));
+	}
 
-			if (first == '#') {
-				ROS_DEBUG("aruco_map: Skipping line as a comment: %s", line.c_str());
-				continue;
-			} else if (isdigit(first)) {
-				// Put the digit back into the stream
-				// Note that this is a non-modifying putback, so this should work with istreams
-				// (see https://en.cppreference.com/w/cpp/io/basic_istream/putback)
-				s.putback(first);
-			} else {
-				// Probably garbage data; inform user and throw an exception, possibly killing nodelet
-				ROS_FATAL("aruco_map: Malformed input: %s", line.c_str());
-				ros::shutdown();
-				throw std::runtime_error("Malformed input");
+	void loadCompiledMap(const std::string& filename, Map& map)
+	{
+		CompiledMap compiled(filename);
+		vector<cv::Point3f> corners(4);
+		for (size_t i = 0; i < compiled.size(); i++) {
+			const CompiledMarker& marker = compiled[i];
+			for (int j = 0; j < 4; j++) {
+				corners[j] = cv::Point3f(marker.corners[j][0], marker.corners[j][1], marker.corners[j][2]);
 			}
+			tf::Quaternion q(marker.rotation[0], marker.rotation[1], marker.rotation[2], marker.rotation[3]);
+			addMarker(map, marker.id, marker.length, tf::Transform(q, tf::Vector3(marker.x, marker.y, marker.z)), corners);
+		}
 
-			if (!(s >> id >> length >> x >> y)) {
-				ROS_ERROR("aruco_map: Not enough data in line: %s; "
-				          "Each marker must have at least id, length, x, y fields", line.c_str());
-				continue;
-			}
-			// Be less strict about z, yaw, pitch roll
-			if (!(s >> z)) {
-				ROS_DEBUG("aruco_map: No z coordinate provided for marker %d, assuming 0", id);
-				z = 0;
-			}
-			if (!(s >> yaw)) {
-				ROS_DEBUG("aruco_map: No yaw provided for marker %d, assuming 0", id);
-				yaw = 0;
-			}
-			if (!(s >> pitch)) {
-				ROS_DEBUG("aruco_map: No pitch provided for marker %d, assuming 0", id);
-				pitch = 0;
-			}
-			if (!(s >> roll)) {
-				ROS_DEBUG("aruco_map: No roll provided for marker %d, assuming 0", id);
-				roll = 0;
-			}
-			addMarker(id, length, x, y, z, yaw, pitch, roll);
+		ROS_INFO("aruco_map: loading compiled map %s complete (%d markers)", filename.c_str(),
+		         static_cast<int>(map.board->ids.size()));
+	}
+
+	bool reloadCallback(std_srvs::Trigger::Request& req, std_srvs::Trigger::Response& res)
+	{
+		res.success = reloadMap(res.message);
+		return true;
+	}
+
+	// Modification time in nanoseconds and size of the file, to detect its changes
+	static bool fileState(const std::string& filename, int64_t& mtime, off_t& size)
+	{
+		struct stat st;
+		if (stat(filename.c_str(), &st) != 0) return false;
+		mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+		size = st.st_size;
+		return true;
+	}
+
+	void watchCallback(const ros::TimerEvent& event)
+	{
+		int64_t mtime;
+		off_t size;
+		if (!fileState(map_, mtime, size)) return;
+		{
+			std::lock_guard<std::mutex> lock(reload_mutex_);
+			if (mtime == map_mtime_ && size == map_size_) return;
+		}
+
+		std::string message;
+		reloadMap(message);
+	}
+
+	// Load the map file again and apply the difference to the current map
+	bool reloadMap(std::string& message)
+	{
+		std::lock_guard<std::mutex> lock(reload_mutex_);
+
+		auto map = createMap();
+		try {
+			loadMap(map_, *map);
+		} catch (const std::runtime_error& e) {
+			message = e.what();
+			ROS_ERROR("aruco_map: reloading failed, keeping the current map: %s", e.what());
+			return false;
+		}
+
+		auto old = std::atomic_load(&current_map_);
+		int added = 0, changed = 0, removed = 0;
+
+		for (unsigned int i = 0; i < map->board->ids.size(); i++) {
+			int old_index = old->index.find(map->board->ids[i]);
+			if (old_index >= 0 && old->board->objPoints[old_index] == map->board->objPoints[i]) continue;
+			if (old_index < 0) added++; else changed++;
+		}
+
+		// visualization update: delete removed markers, then add the whole map, so that it's complete
+		// for late subscribers of the latched topic as well
+		visualization_msgs::MarkerArray vis_update;
+		for (int id : old->board->ids) {
+			if (map->index.find(id) >= 0) continue;
+			removed++;
+			visualization_msgs::Marker marker;
+			marker.header.frame_id = transform_.child_frame_id;
+			marker.action = visualization_msgs::Marker::DELETE;
+			marker.ns = "aruco_map_marker";
+			marker.id = id;
+			vis_update.markers.push_back(marker);
 		}
+		vis_update.markers.insert(vis_update.markers.end(), map->vis_array.markers.begin(), map->vis_array.markers.end());
 
-		ROS_INFO("aruco_map: loading %s complete (%d markers)", filename.c_str(), static_cast<int>(board_->ids.size()));
+		std::atomic_store(&current_map_, std::shared_ptr<const Map>(map));
+
+		if (added + changed + removed > 0) {
+			publishMarkersFrames(*map);
+			vis_markers_pub_.publish(vis_update);
+			updateMapImage();
+		}
+
+		message = "added " + std::to_string(added) + ", changed " + std::to_string(changed) +
+		          ", removed " + std::to_string(removed) + " markers";
+		ROS_INFO("aruco_map: map reloaded: %s", message.c_str());
+		return true;
 	}
 
-	void createGridBoard()
+	void createGridBoard(Map& map)
 	{
 		ROS_INFO("aruco_map: generate gridboard");
 		ROS_WARN("aruco_map: gridboard maps are deprecated");
@@ -363,7 +948,7 @@ publish_debug:
 				double x_pos = x * (markers_side + markers_sep_x);
 				double y_pos = max_y - y * (markers_side + markers_sep_y) - markers_side;
 				ROS_INFO("add marker %d %g %g", marker_ids[y * markers_y + x], x_pos, y_pos);
-				addMarker(marker_ids[y * markers_y + x], markers_side, x_pos, y_pos, 0, 0, 0, 0);
+				addMarker(map, marker_ids[y * markers_y + x], markers_side, x_pos, y_pos, 0, 0, 0, 0);
 			}
 		}
 	}
@@ -383,11 +968,24 @@ publish_debug:
 	// 	vis_array_.markers.push_back(marker);
 	// }
 
-	void addMarker(int id, double length, double x, double y, double z,
+	void addMarker(Map& map, int id, double length, double x, double y, double z,
 				   double yaw, double pitch, double roll)
+	{
+		// Create transform
+		tf::Quaternion q;
+		q.setRPY(roll, pitch, yaw);
+		tf::Transform transform(q, tf::Vector3(x, y, z));
+
+		vector<cv::Point3f> obj_points;
+		getMarkerCorners(length, transform, obj_points);
+		addMarker(map, id, length, transform, obj_points);
+	}
+
+	void addMarker(Map& map, int id, double length, const tf::Transform& transform,
+	               const vector<cv::Point3f>& obj_points)
 	{
 		// Check whether the id is in range for current dictionary
-		int num_markers = board_->dictionary->bytesList.rows;
+		int num_markers = map.board->dictionary->bytesList.rows;
 		if (num_markers <= id) {
 			ROS_ERROR("aruco_map: Marker id %d is not in dictionary; current dictionary contains %d markers. "
 			          "Please see https://github.com/CopterExpress/clever/blob/master/aruco_pose/README.md#parameters for details",
@@ -395,38 +993,22 @@ publish_debug:
 			return;
 		}
 		// Check if marker is already in the board
-		if (std::count(board_->ids.begin(), board_->ids.end(), id) > 0) {
+		if (map.index.find(id) >= 0) {
 			ROS_ERROR("aruco_map: Marker id %d is already in the map", id);
 			return;
 		}
-		// Create transform
-		tf::Quaternion q;
-		q.setRPY(roll, pitch, yaw);
-		tf::Transform transform(q, tf::Vector3(x, y, z));
 
-		/* marker's corners:
-			0    1
-			3    2
-		*/
-		double halflen = length / 2;
-		tf::Point p0(-halflen, halflen, 0);
-		tf::Point p1(halflen, halflen, 0);
-		tf::Point p2(halflen, -halflen, 0);
-		tf::Point p3(-halflen, -halflen, 0);
-		p0 = transform * p0;
-		p1 = transform * p1;
-		p2 = transform * p2;
-		p3 = transform * p3;
-
-		vector<cv::Point3f> obj_points = {
-			cv::Point3f(p0.x(), p0.y(), p0.z()),
-			cv::Point3f(p1.x(), p1.y(), p1.z()),
-			cv::Point3f(p2.x(), p2.y(), p2.z()),
-			cv::Point3f(p3.x(), p3.y(), p3.z())
-		};
-
-		board_->ids.push_back(id);
-		board_->objPoints.push_back(obj_points);
+		double x = transform.getOrigin().x();
+		double y = transform.getOrigin().y();
+		double z = transform.getOrigin().z();
+
+		map.index.add(id, map.board->ids.size(), cv::Point3f(x, y, z));
+		map.board->ids.push_back(id);
+		map.board->objPoints.push_back(obj_points);
+		map.max_length = std::max(map.max_length, length);
+		map.min_z = map.board->ids.size() == 1 ? z : std::min(map.min_z, z);
+		map.max_z = map.board->ids.size() == 1 ? z : std::max(map.max_z, z);
+		map.mean_z += (z - map.mean_z) / map.board->ids.size();
 
 		// Add marker's static transform
 		if (!markers_frame_.empty()) {
@@ -434,7 +1016,7 @@ publish_debug:
 			marker_transform.header.frame_id = markers_parent_frame_;
 			marker_transform.child_frame_id = markers_frame_ + std::to_string(id);
 			tf::transformTFToMsg(transform, marker_transform.transform);
-			markers_transforms_.push_back(marker_transform);
+			map.markers_transforms.push_back(marker_transform);
 		}
 
 		// Add visualization marker
@@ -442,7 +1024,7 @@ publish_debug:
 		marker.header.frame_id = transform_.child_frame_id;
 		// marker.header.stamp = stamp;
 		marker.action = visualization_msgs::Marker::ADD;
-		marker.id = vis_array_.markers.size();
+		marker.id = id; // stable across reloads
 		marker.ns = "aruco_map_marker";
 		marker.type = visualization_msgs::Marker::CUBE;
 		marker.scale.x = length;
@@ -455,9 +1037,9 @@ publish_debug:
 		marker.pose.position.x = x;
 		marker.pose.position.y = y;
 		marker.pose.position.z = z;
-		tf::quaternionTFToMsg(q, marker.pose.orientation);
+		tf::quaternionTFToMsg(transform.getRotation(), marker.pose.orientation);
 		marker.frame_locked = true;
-		vis_array_.markers.push_back(marker);
+		map.vis_array.markers.push_back(marker);
 
 		// Add linking line
 		// geometry_msgs::Point p;
@@ -467,30 +1049,80 @@ publish_debug:
 		// vis_array_.markers.at(0).points.push_back(p);
 	}
 
-	void publishMarkersFrames()
+	// Publish static transforms of exactly the map's markers (with the other maps' of the process),
+	// replacing the previous latched message
+	void publishMarkersFrames(const Map& map)
+	{
+		if (markers_frame_.empty()) return;
+		std::lock_guard<std::mutex> lock(static_frames_mutex);
+		static_frames[getName()] = map.markers_transforms;
+		tf2_msgs::TFMessage msg;
+		for (auto const& item : static_frames) {
+			msg.transforms.insert(msg.transforms.end(), item.second.begin(), item.second.end());
+		}
+		static_tf_pub_.publish(msg);
+	}
+
+	// Map has changed, publish its image if anyone is subscribed, otherwise on subscription
+	void updateMapImage()
 	{
-		if (!markers_transforms_.empty()) {
-			static_br_.sendTransform(markers_transforms_);
+		std::lock_guard<std::mutex> lock(image_mutex_);
+		image_published_ = false;
+		if (img_pub_.getNumSubscribers() > 0) {
+			publishMapImage();
+		}
+	}
+
+	void imageConnectCallback(const ros::SingleSubscriberPublisher& pub)
+	{
+		std::lock_guard<std::mutex> lock(image_mutex_);
+		if (!image_published_) {
+			publishMapImage();
 		}
 	}
 
 	void publishMapImage()
 	{
-		cv::Size size(image_width_, image_height_);
+		auto map = std::atomic_load(&current_map_);
+		if (!map) return; // not initialized yet
+
 		cv::Mat image;
 		cv_bridge::CvImage msg;
 
-		if (!board_->ids.empty()) {
-			_drawPlanarBoard(board_, size, image, image_margin_, 1);
-		} else {
-			// empty map
-			image.create(size, CV_8UC1);
-			image.setTo(cv::Scalar::all(255));
+		// check the cache
+		std::string cache_file;
+		if (!image_cache_.empty() && map->hash != 0) {
+			char name[128];
+			snprintf(name, sizeof(name), "/aruco_map_%016llx_%dx%d_%d_%d.png", (unsigned long long)map->hash,
+			         image_width_, image_height_, image_margin_, dictionary_);
+			cache_file = image_cache_ + name;
+			image = cv::imread(cache_file, cv::IMREAD_GRAYSCALE);
+		}
+
+		if (image.empty()) {
+			renderMapImage(*map, image);
+			if (!cache_file.empty() && !cv::imwrite(cache_file, image)) {
+				ROS_WARN("aruco_map: can't write map image cache %s", cache_file.c_str());
+			}
 		}
 
 		msg.encoding = sensor_msgs::image_encodings::MONO8;
 		msg.image = image;
 		img_pub_.publish(msg.toImageMsg());
+		image_published_ = true;
+	}
+
+	void renderMapImage(const Map& map, cv::Mat& image)
+	{
+		cv::Size size(image_width_, image_height_);
+
+		if (!map.board->ids.empty()) {
+			_drawPlanarBoard(map.board, size, image, image_margin_, 1);
+		} else {
+			// empty map
+			image.create(size, CV_8UC1);
+			image.setTo(cv::Scalar::all(255));
+		}
 	}
 };
 
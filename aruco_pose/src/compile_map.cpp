@@ -0,0 +1,37 @@
+/*
+ * Compile text markers map to binary format for fast loading
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include "map_file.h"
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <map.txt> <compiled map>" << std::endl;
+		return 1;
+	}
+
+	if (!std::ifstream(argv[1]).good()) {
+		std::cerr << "Error: can't open " << argv[1] << std::endl;
+		return 1;
+	}
+
+	try {
+		std::vector<MapMarker> markers;
+		readMap(argv[1], markers);
+		writeCompiledMap(argv[2], markers);
+		std::cout << "Compiled " << markers.size() << " markers to " << argv[2] << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -98,7 +98,17 @@ void _drawPlanarBoard(Board *_board, Size outSize, OutputArray _img, int marginS
 
 		// remove perspective
 		Mat transformation = getAffineTransform(inCorners, outCorners);
-		warpAffine(marker, out, transformation, out.size(), INTER_LINEAR,
+
+		// warp only to the marker's bounding rectangle (with a margin for interpolation)
+		std::vector<Point2f> rectCorners(outCorners, outCorners + 3);
+		rectCorners.push_back(outCorners[0] + outCorners[2] - outCorners[1]);
+		Rect rect = boundingRect(rectCorners);
+		rect = Rect(rect.x - 2, rect.y - 2, rect.width + 4, rect.height + 4) & Rect(0, 0, out.cols, out.rows);
+		if (rect.area() == 0) continue;
+		transformation.at<double>(0, 2) -= rect.x;
+		transformation.at<double>(1, 2) -= rect.y;
+		Mat roi = out(rect);
+		warpAffine(marker, roi, transformation, rect.size(), INTER_LINEAR,
 						BORDER_TRANSPARENT);
 	}
 }
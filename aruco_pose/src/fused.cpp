@@ -0,0 +1,82 @@
+/*
+ * In-process hand-off of detected markers from aruco_detect to aruco_map
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include "fused.h"
+
+// Registered consumer; the mutex is held while the callback runs, so unregistering waits for it
+struct ConsumerEntry
+{
+	MarkersConsumer callback;
+	std::mutex mutex;
+	bool active = true;
+};
+
+// detector name => consumer name => consumer
+static std::map<std::string, std::map<std::string, std::shared_ptr<ConsumerEntry>>> consumers;
+static std::mutex consumers_mutex;
+
+void registerMarkersConsumer(const std::string& detector, const std::string& consumer, const MarkersConsumer& callback)
+{
+	auto entry = std::make_shared<ConsumerEntry>();
+	entry->callback = callback;
+	std::lock_guard<std::mutex> lock(consumers_mutex);
+	consumers[detector][consumer] = entry;
+}
+
+void unregisterMarkersConsumer(const std::string& detector, const std::string& consumer)
+{
+	std::shared_ptr<ConsumerEntry> entry;
+	{
+		std::lock_guard<std::mutex> lock(consumers_mutex);
+		auto it = consumers.find(detector);
+		if (it == consumers.end()) return;
+		auto consumer_it = it->second.find(consumer);
+		if (consumer_it == it->second.end()) return;
+		entry = consumer_it->second;
+		it->second.erase(consumer_it);
+		if (it->second.empty()) consumers.erase(it);
+	}
+	// wait for the running call to finish and prevent further calls
+	std::lock_guard<std::mutex> lock(entry->mutex);
+	entry->active = false;
+}
+
+bool hasMarkersConsumers(const std::string& detector)
+{
+	std::lock_guard<std::mutex> lock(consumers_mutex);
+	return consumers.find(detector) != consumers.end();
+}
+
+void callMarkersConsumers(const std::string& detector,
+                          const sensor_msgs::ImageConstPtr& image,
+                          const sensor_msgs::CameraInfoConstPtr& cinfo,
+                          const std_msgs::Header& header,
+                          const std::vector<std::vector<cv::Point2f>>& corners,
+                          const std::vector<int>& ids)
+{
+	std::vector<std::shared_ptr<ConsumerEntry>> entries;
+	{
+		std::lock_guard<std::mutex> lock(consumers_mutex);
+		auto it = consumers.find(detector);
+		if (it == consumers.end()) return;
+		for (auto const& consumer : it->second) {
+			entries.push_back(consumer.second);
+		}
+	}
+	// call without holding the registry lock, as processing may take long
+	for (auto const& entry : entries) {
+		std::lock_guard<std::mutex> lock(entry->mutex);
+		if (entry->active) {
+			entry->callback(image, cinfo, header, corners, ids);
+		}
+	}
+}
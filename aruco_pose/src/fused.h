@@ -0,0 +1,41 @@
+/*
+ * In-process hand-off of detected markers from aruco_detect to aruco_map
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <std_msgs/Header.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <opencv2/opencv.hpp>
+
+typedef std::function<void(const sensor_msgs::ImageConstPtr& image,
+                           const sensor_msgs::CameraInfoConstPtr& cinfo,
+                           const std_msgs::Header& header,
+                           const std::vector<std::vector<cv::Point2f>>& corners,
+                           const std::vector<int>& ids)> MarkersConsumer;
+
+// Register consumer of markers detected by the detector nodelet (full nodelet names are used)
+void registerMarkersConsumer(const std::string& detector, const std::string& consumer, const MarkersConsumer& callback);
+
+// Unregister consumer; blocks until its running call, if any, is finished
+void unregisterMarkersConsumer(const std::string& detector, const std::string& consumer);
+
+// Check if the detector has consumers
+bool hasMarkersConsumers(const std::string& detector);
+
+// Call consumers of the detector in the calling thread
+void callMarkersConsumers(const std::string& detector,
+                          const sensor_msgs::ImageConstPtr& image,
+                          const sensor_msgs::CameraInfoConstPtr& cinfo,
+                          const std_msgs::Header& header,
+                          const std::vector<std::vector<cv::Point2f>>& corners,
+                          const std::vector<int>& ids);
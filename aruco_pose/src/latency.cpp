@@ -0,0 +1,90 @@
+/*
+ * Processing stages latency statistics
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <algorithm>
+#include <diagnostic_msgs/KeyValue.h>
+#include "latency.h"
+
+using std::chrono::steady_clock;
+
+void LatencyStats::start()
+{
+	if (!enabled) return;
+	last_ = steady_clock::now();
+}
+
+void LatencyStats::stage(const std::string& name)
+{
+	if (!enabled) return;
+	auto now = steady_clock::now();
+	add(name, std::chrono::duration<double>(now - last_).count());
+	last_ = now;
+}
+
+void LatencyStats::latency(const ros::Time& stamp)
+{
+	if (!enabled) return;
+	add("latency", (ros::Time::now() - stamp).toSec());
+}
+
+void LatencyStats::add(const std::string& name, double duration)
+{
+	auto samples = std::find_if(stages_.begin(), stages_.end(),
+	                            [&name](const Samples& s) { return s.name == name; });
+	if (samples == stages_.end()) {
+		stages_.emplace_back();
+		samples = stages_.end() - 1;
+		samples->name = name;
+		samples->values.reserve(window_);
+	}
+
+	if (samples->values.size() < window_) {
+		samples->values.push_back(duration);
+	} else {
+		samples->values[samples->next] = duration; // replace the oldest sample
+	}
+	samples->next = (samples->next + 1) % window_;
+}
+
+void LatencyStats::fill(diagnostic_msgs::DiagnosticStatus& status) const
+{
+	static const double percentiles[] = { 0.5, 0.95, 0.99 };
+	static const char* labels[] = { "p50", "p95", "p99" };
+
+	status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	status.values.clear();
+
+	diagnostic_msgs::KeyValue kv;
+	for (auto const& samples : stages_) {
+		std::vector<double> sorted(samples.values);
+		std::sort(sorted.begin(), sorted.end());
+		for (int i = 0; i < 3; i++) {
+			size_t index = std::min(sorted.size() - 1, (size_t)(percentiles[i] * sorted.size()));
+			kv.key = samples.name + " " + labels[i] + ", ms";
+			kv.value = std::to_string(sorted[index] * 1000);
+			status.values.push_back(kv);
+		}
+	}
+}
+
+void LatencyStats::publish(const ros::Publisher& pub, const std::string& name)
+{
+	if (!enabled) return;
+
+	ros::Time now = ros::Time::now();
+	if (now - published_ < ros::Duration(1)) return;
+	published_ = now;
+
+	diagnostic_msgs::DiagnosticArray diag;
+	diag.header.stamp = now;
+	diag.status.resize(1);
+	diag.status[0].name = name + ": latency";
+	fill(diag.status[0]);
+	pub.publish(diag);
+}
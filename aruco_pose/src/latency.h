@@ -0,0 +1,55 @@
+/*
+ * Processing stages latency statistics
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+// Collects durations of processing stages over a rolling window of frames
+class LatencyStats
+{
+public:
+	bool enabled = false;
+
+	explicit LatencyStats(size_t window = 200): window_(window) {}
+
+	// Start measuring a new frame
+	void start();
+
+	// Finish a stage started by the previous call of start or stage
+	void stage(const std::string& name);
+
+	// Add latency from the camera frame stamp to the current time
+	void latency(const ros::Time& stamp);
+
+	// Fill diagnostic status with stages' percentiles in milliseconds
+	void fill(diagnostic_msgs::DiagnosticStatus& status) const;
+
+	// Publish diagnostics, not more often than once per second
+	void publish(const ros::Publisher& pub, const std::string& name);
+
+private:
+	struct Samples {
+		std::string name;
+		std::vector<double> values;
+		size_t next = 0;
+	};
+
+	size_t window_;
+	std::vector<Samples> stages_;
+	std::chrono::steady_clock::time_point last_;
+	ros::Time published_;
+
+	void add(const std::string& name, double duration);
+};
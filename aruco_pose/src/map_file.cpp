@@ -0,0 +1,237 @@
+/*
+ * Reading and compiling markers map files
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ros/ros.h>
+#include "map_file.h"
+
+/* Compiled map file layout:
+   header: char magic[8], uint32 version, uint32 byte order mark, uint32 markers count, uint32 reserved
+   followed by CompiledMarker records in the byte order of the machine, that compiled the map */
+
+static const char MAGIC[8] = {'A', 'R', 'U', 'C', 'O', 'M', 'A', 'P'};
+static const uint32_t VERSION = 2;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t) * 4; // keeps the records 8-byte aligned
+
+void readMap(const std::string& filename, std::vector<MapMarker>& markers)
+{
+	std::ifstream f(filename);
+	std::string line;
+
+	if (!f.good()) {
+		throw std::runtime_error(filename + ": " + strerror(errno));
+	}
+
+	while (std::getline(f, line)) {
+		MapMarker marker;
+
+		std::istringstream s(line);
+
+		// Read first character to see whether it's a comment
+		char first = 0;
+		if (!(s >> first)) {
+			// No non-whitespace characters, must be a blank line
+			continue;
+		}
+
+		if (first == '#') {
+			ROS_DEBUG("aruco_map: Skipping line as a comment: %s", line.c_str());
+			continue;
+		} else if (isdigit(first)) {
+			// Put the digit back into the stream
+			// Note that this is a non-modifying putback, so this should work with istreams
+			// (see https://en.cppreference.com/w/cpp/io/basic_istream/putback)
+			s.putback(first);
+		} else {
+			// Probably garbage data; throw an exception, the caller decides whether it's fatal
+			throw std::runtime_error("Malformed input: " + line);
+		}
+
+		if (!(s >> marker.id >> marker.length >> marker.x >> marker.y)) {
+			ROS_ERROR("aruco_map: Not enough data in line: %s; "
+			          "Each marker must have at least id, length, x, y fields", line.c_str());
+			continue;
+		}
+		// Be less strict about z, yaw, pitch roll
+		if (!(s >> marker.z)) {
+			ROS_DEBUG("aruco_map: No z coordinate provided for marker %d, assuming 0", marker.id);
+			marker.z = 0;
+		}
+		if (!(s >> marker.yaw)) {
+			ROS_DEBUG("aruco_map: No yaw provided for marker %d, assuming 0", marker.id);
+			marker.yaw = 0;
+		}
+		if (!(s >> marker.pitch)) {
+			ROS_DEBUG("aruco_map: No pitch provided for marker %d, assuming 0", marker.id);
+			marker.pitch = 0;
+		}
+		if (!(s >> marker.roll)) {
+			ROS_DEBUG("aruco_map: No roll provided for marker %d, assuming 0", marker.id);
+			marker.roll = 0;
+		}
+		markers.push_back(marker);
+	}
+}
+
+void getMarkerCorners(double length, const tf::Transform& transform, std::vector<cv::Point3f>& corners)
+{
+	/* marker's corners:
+		0    1
+		3    2
+	*/
+	double halflen = length / 2;
+	tf::Point p0(-halflen, halflen, 0);
+	tf::Point p1(halflen, halflen, 0);
+	tf::Point p2(halflen, -halflen, 0);
+	tf::Point p3(-halflen, -halflen, 0);
+	p0 = transform * p0;
+	p1 = transform * p1;
+	p2 = transform * p2;
+	p3 = transform * p3;
+
+	corners = {
+		cv::Point3f(p0.x(), p0.y(), p0.z()),
+		cv::Point3f(p1.x(), p1.y(), p1.z()),
+		cv::Point3f(p2.x(), p2.y(), p2.z()),
+		cv::Point3f(p3.x(), p3.y(), p3.z())
+	};
+}
+
+void writeCompiledMap(const std::string& filename, const std::vector<MapMarker>& markers)
+{
+	std::ofstream f(filename, std::ios::binary);
+	if (!f.good()) {
+		throw std::runtime_error(filename + ": " + strerror(errno));
+	}
+
+	uint32_t count = markers.size(), reserved = 0;
+	f.write(MAGIC, sizeof(MAGIC));
+	f.write(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+	f.write(reinterpret_cast<const char*>(&BYTE_ORDER_MARK), sizeof(BYTE_ORDER_MARK));
+	f.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	f.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+
+	std::vector<cv::Point3f> corners;
+	for (auto const& marker : markers) {
+		CompiledMarker record;
+		memset(&record, 0, sizeof(record));
+		record.id = marker.id;
+		record.length = marker.length;
+		record.x = marker.x;
+		record.y = marker.y;
+		record.z = marker.z;
+		record.yaw = marker.yaw;
+		record.pitch = marker.pitch;
+		record.roll = marker.roll;
+
+		tf::Quaternion q;
+		q.setRPY(marker.roll, marker.pitch, marker.yaw);
+		record.rotation[0] = q.x();
+		record.rotation[1] = q.y();
+		record.rotation[2] = q.z();
+		record.rotation[3] = q.w();
+
+		getMarkerCorners(marker.length, tf::Transform(q, tf::Vector3(marker.x, marker.y, marker.z)), corners);
+		for (int i = 0; i < 4; i++) {
+			record.corners[i][0] = corners[i].x;
+			record.corners[i][1] = corners[i].y;
+			record.corners[i][2] = corners[i].z;
+		}
+		f.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	}
+
+	if (!f.good()) {
+		throw std::runtime_error(filename + ": write error");
+	}
+}
+
+bool isCompiledMap(const std::string& filename)
+{
+	std::ifstream f(filename, std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	return f.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+uint64_t hashFile(const std::string& filename)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f.good()) {
+		throw std::runtime_error(filename + ": " + strerror(errno));
+	}
+
+	uint64_t hash = 14695981039346656037ULL;
+	char buf[4096];
+	while (f.read(buf, sizeof(buf)) || f.gcount() > 0) {
+		for (std::streamsize i = 0; i < f.gcount(); i++) {
+			hash ^= static_cast<unsigned char>(buf[i]);
+			hash *= 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+CompiledMap::CompiledMap(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error(filename + ": " + strerror(errno));
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < HEADER_SIZE) {
+		close(fd);
+		throw std::runtime_error(filename + ": not a compiled map");
+	}
+
+	length_ = st.st_size;
+	data_ = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data_ == MAP_FAILED) {
+		data_ = nullptr;
+		throw std::runtime_error(filename + ": " + strerror(errno));
+	}
+
+	const char *header = static_cast<const char*>(data_);
+	uint32_t version, byte_order, count;
+	memcpy(&version, header + sizeof(MAGIC), sizeof(version));
+	memcpy(&byte_order, header + sizeof(MAGIC) + sizeof(uint32_t), sizeof(byte_order));
+	memcpy(&count, header + sizeof(MAGIC) + sizeof(uint32_t) * 2, sizeof(count));
+
+	if (memcmp(header, MAGIC, sizeof(MAGIC)) == 0 && byte_order == __builtin_bswap32(BYTE_ORDER_MARK)) {
+		munmap(data_, length_);
+		data_ = nullptr;
+		throw std::runtime_error(filename + ": compiled map has different byte order, compile it on this machine");
+	}
+
+	if (memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || byte_order != BYTE_ORDER_MARK ||
+	    length_ != HEADER_SIZE + (size_t)count * sizeof(CompiledMarker)) {
+		munmap(data_, length_);
+		data_ = nullptr;
+		throw std::runtime_error(filename + ": malformed compiled map or unsupported version");
+	}
+
+	size_ = count;
+	markers_ = reinterpret_cast<const CompiledMarker*>(header + HEADER_SIZE);
+}
+
+CompiledMap::~CompiledMap()
+{
+	if (data_) {
+		munmap(data_, length_);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Reading and compiling markers map files
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <tf/transform_datatypes.h>
+#include <opencv2/opencv.hpp>
+
+struct MapMarker
+{
+	int id;
+	double length, x, y, z, yaw, pitch, roll;
+};
+
+// Marker's record of compiled map file
+struct CompiledMarker
+{
+	int32_t id;
+	uint32_t reserved; // zero
+	double length, x, y, z, yaw, pitch, roll;
+	double rotation[4]; // quaternion: x, y, z, w
+	float corners[4][3];
+};
+
+static_assert(sizeof(CompiledMarker) == 144, "unexpected compiled marker record size");
+
+// Read text map file; throws std::runtime_error if the file can't be read or is malformed
+void readMap(const std::string& filename, std::vector<MapMarker>& markers);
+
+// Calculate marker's corners in map frame
+void getMarkerCorners(double length, const tf::Transform& transform, std::vector<cv::Point3f>& corners);
+
+// Write compiled map file with precomputed markers' transforms and corners
+void writeCompiledMap(const std::string& filename, const std::vector<MapMarker>& markers);
+
+// Check if the file is a compiled map
+bool isCompiledMap(const std::string& filename);
+
+// FNV-1a hash of the file contents; throws std::runtime_error if the file can't be read
+uint64_t hashFile(const std::string& filename);
+
+// Compiled map file mapped to memory
+class CompiledMap
+{
+public:
+	// Throws std::runtime_error if the file can't be mapped or is malformed
+	explicit CompiledMap(const std::string& filename);
+	~CompiledMap();
+	CompiledMap(const CompiledMap&) = delete;
+	CompiledMap& operator=(const CompiledMap&) = delete;
+
+	size_t size() const { return size_; }
+	const CompiledMarker& operator[](size_t i) const { return markers_[i]; }
+
+private:
+	void *data_ = nullptr;
+	size_t length_ = 0;
+	size_t size_ = 0;
+	const CompiledMarker *markers_ = nullptr;
+};
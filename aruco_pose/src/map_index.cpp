@@ -0,0 +1,64 @@
+/*
+ * Index of markers map
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include "map_index.h"
+
+void MarkerIndex::clear()
+{
+	ids_.clear();
+	grid_.clear();
+	centers_.clear();
+}
+
+void MarkerIndex::add(int id, int index, const cv::Point3f& center)
+{
+	ids_[id] = index;
+	grid_[key(cell(center.x), cell(center.y))].push_back(index);
+	if (centers_.size() <= (size_t)index) {
+		centers_.resize(index + 1);
+	}
+	centers_[index] = center;
+}
+
+int MarkerIndex::find(int id) const
+{
+	auto item = ids_.find(id);
+	return item == ids_.end() ? -1 : item->second;
+}
+
+void MarkerIndex::query(const cv::Point3f& point, double radius, std::vector<int>& indices) const
+{
+	indices.clear();
+	int x_min = cell(point.x - radius), x_max = cell(point.x + radius);
+	int y_min = cell(point.y - radius), y_max = cell(point.y + radius);
+
+	if ((double)(x_max - x_min + 1) * (y_max - y_min + 1) > grid_.size()) {
+		// the area covers more cells than there are non-empty ones, check all the cells
+		for (auto const& item : grid_) {
+			for (int index : item.second) {
+				if (std::hypot(centers_[index].x - point.x, centers_[index].y - point.y) <= radius) {
+					indices.push_back(index);
+				}
+			}
+		}
+		return;
+	}
+
+	for (int x = x_min; x <= x_max; x++) {
+		for (int y = y_min; y <= y_max; y++) {
+			auto item = grid_.find(key(x, y));
+			if (item == grid_.end()) continue;
+			for (int index : item->second) {
+				if (std::hypot(centers_[index].x - point.x, centers_[index].y - point.y) <= radius) {
+					indices.push_back(index);
+				}
+			}
+		}
+	}
+}
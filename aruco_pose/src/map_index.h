@@ -0,0 +1,44 @@
+/*
+ * Index of markers map
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+#include <opencv2/opencv.hpp>
+
+// Index of map's markers by id and by position on a grid in XY plane
+class MarkerIndex
+{
+public:
+	explicit MarkerIndex(double cell_size = 1.0): cell_size_(cell_size) {}
+
+	void clear();
+
+	// Add marker with given index in the board
+	void add(int id, int index, const cv::Point3f& center);
+
+	// Get marker's index in the board by id, -1 if not found
+	int find(int id) const;
+
+	// Get indexes of markers, which centers are within radius from the point in XY plane
+	void query(const cv::Point3f& point, double radius, std::vector<int>& indices) const;
+
+	size_t size() const { return ids_.size(); }
+
+private:
+	double cell_size_;
+	std::unordered_map<int, int> ids_;
+	std::unordered_map<int64_t, std::vector<int>> grid_;
+	std::vector<cv::Point3f> centers_;
+
+	int cell(double coord) const { return (int)std::floor(coord / cell_size_); }
+	static int64_t key(int x, int y) { return ((int64_t)x << 32) | (uint32_t)y; }
+};
@@ -0,0 +1,89 @@
+/*
+ * Tracking ArUco markers between frames
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <cmath>
+#include "tracker.h"
+
+using std::vector;
+
+bool MarkerTracker::needDetection() const
+{
+	return ids_.empty() || frames_ + 1 >= keyframe_interval;
+}
+
+void MarkerTracker::reset(const cv::Mat& image, const vector<vector<cv::Point2f>>& corners,
+                          const vector<int>& ids)
+{
+	frames_ = 0;
+	ids_ = ids;
+	points_.clear();
+	for (auto const& marker_corners : corners) {
+		points_.insert(points_.end(), marker_corners.begin(), marker_corners.end());
+	}
+	if (!ids_.empty()) {
+		buildPyramid(image, pyramid_);
+	}
+}
+
+bool MarkerTracker::track(const cv::Mat& image, const cv::Ptr<cv::aruco::DetectorParameters>& params,
+                          vector<vector<cv::Point2f>>& corners, vector<int>& ids)
+{
+	if (ids_.empty()) return false;
+
+	buildPyramid(image, next_pyramid_);
+
+	// track corners forward and backward, so badly tracked corners can be rejected
+	cv::calcOpticalFlowPyrLK(pyramid_, next_pyramid_, points_, next_points_, status_, err_,
+	                         win_size_, max_level_);
+	cv::calcOpticalFlowPyrLK(next_pyramid_, pyramid_, next_points_, back_points_, back_status_, err_,
+	                         win_size_, max_level_);
+
+	for (unsigned int i = 0; i < points_.size(); i++) {
+		if (!status_[i] || !back_status_[i] || cv::norm(back_points_[i] - points_[i]) > max_error) {
+			return false;
+		}
+	}
+
+	// check that markers are still convex and didn't change their size abruptly
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		vector<cv::Point2f> prev(points_.begin() + i * 4, points_.begin() + i * 4 + 4);
+		vector<cv::Point2f> next(next_points_.begin() + i * 4, next_points_.begin() + i * 4 + 4);
+		if (!cv::isContourConvex(next)) return false;
+		double ratio = cv::contourArea(next) / cv::contourArea(prev);
+		if (ratio < 0.8 || ratio > 1.25) return false;
+	}
+
+	// refine corners in small windows around them as detectMarkers does
+	if (params->cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX) {
+		cv::cornerSubPix(image, next_points_,
+		                 cv::Size(params->cornerRefinementWinSize, params->cornerRefinementWinSize),
+		                 cv::Size(-1, -1),
+		                 cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+		                                  params->cornerRefinementMaxIterations,
+		                                  params->cornerRefinementMinAccuracy));
+	}
+
+	ids = ids_;
+	corners.resize(ids_.size());
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		corners[i].assign(next_points_.begin() + i * 4, next_points_.begin() + i * 4 + 4);
+	}
+
+	std::swap(points_, next_points_);
+	std::swap(pyramid_, next_pyramid_);
+	frames_++;
+	return true;
+}
+
+void MarkerTracker::buildPyramid(const cv::Mat& image, vector<cv::Mat>& pyramid) const
+{
+	// don't reuse input image, as it's owned by the image message
+	cv::buildOpticalFlowPyramid(image, pyramid, win_size_, max_level_, true,
+	                            cv::BORDER_REFLECT_101, cv::BORDER_CONSTANT, false);
+}
@@ -0,0 +1,46 @@
+/*
+ * Tracking ArUco markers between frames
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+
+// Tracks corners of detected markers with pyramidal Lucas-Kanade optical flow, so full-frame
+// detection needs to be run only on keyframes
+class MarkerTracker
+{
+public:
+	int keyframe_interval = 10; // run detection at least every N frames
+	double max_error = 1.0; // max forward-backward tracking error, px
+
+	// Check if full detection should be run on the next frame
+	bool needDetection() const;
+
+	// Start tracking markers detected on the keyframe
+	void reset(const cv::Mat& image, const std::vector<std::vector<cv::Point2f>>& corners,
+	           const std::vector<int>& ids);
+
+	// Track markers to the next frame; returns false if any of the markers is lost
+	bool track(const cv::Mat& image, const cv::Ptr<cv::aruco::DetectorParameters>& params,
+	           std::vector<std::vector<cv::Point2f>>& corners, std::vector<int>& ids);
+
+private:
+	const cv::Size win_size_{15, 15};
+	const int max_level_ = 2;
+	int frames_ = 0; // frames since keyframe
+	std::vector<int> ids_;
+	std::vector<cv::Point2f> points_, next_points_, back_points_;
+	std::vector<uchar> status_, back_status_;
+	std::vector<float> err_;
+	std::vector<cv::Mat> pyramid_, next_pyramid_;
+
+	void buildPyramid(const cv::Mat& image, std::vector<cv::Mat>& pyramid) const;
+};
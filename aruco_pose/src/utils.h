@@ -11,9 +11,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <ros/ros.h>
 #include <tf/transform_datatypes.h>
+#include <tf2/exceptions.h>
+#include <tf2_ros/buffer.h>
 #include <geometry_msgs/Quaternion.h>
 #include <geometry_msgs/Pose.h>
 #include <geometry_msgs/Vector3.h>
@@ -41,6 +44,34 @@ static void parseCameraInfo(const sensor_msgs::CameraInfoConstPtr& cinfo,
 		dist.at<double>(k) = cinfo->D[k];
 }
 
+// Camera matrix, its inverse and distortion coefficients, that are parsed only when the calibration changes
+class CameraIntrinsics
+{
+public:
+	cv::Mat matrix = cv::Mat::zeros(3, 3, CV_64F);
+	cv::Matx33d matrix_inv = cv::Matx33d::zeros();
+	cv::Mat dist = cv::Mat::zeros(8, 1, CV_64F);
+
+	// Returns true if the calibration has changed, `dist` may be reallocated then
+	bool update(const sensor_msgs::CameraInfoConstPtr& cinfo)
+	{
+		if (cinfo == cinfo_ || (cinfo_ && cinfo->K == cinfo_->K && cinfo->D == cinfo_->D)) {
+			cinfo_ = cinfo;
+			return false;
+		}
+		cinfo_ = cinfo;
+		// rational and thin prism models have 12 and 14 coefficients
+		dist.create(std::max<int>(8, cinfo->D.size()), 1, CV_64F);
+		dist.setTo(0);
+		parseCameraInfo(cinfo, matrix, dist);
+		matrix_inv = static_cast<cv::Matx33d>(matrix).inv();
+		return true;
+	}
+
+private:
+	sensor_msgs::CameraInfoConstPtr cinfo_;
+};
+
 inline void rotatePoint(cv::Point3f& p, cv::Point3f origin, float angle)
 {
 	float s = sin(angle);
@@ -95,6 +126,21 @@ inline void fillTransform(geometry_msgs::Transform& transform, const cv::Vec3d&
 	transform.rotation.z = q.z();
 }
 
+inline void transformToRvecTvec(const geometry_msgs::Transform& transform, cv::Vec3d& rvec, cv::Vec3d& tvec)
+{
+	tvec[0] = transform.translation.x;
+	tvec[1] = transform.translation.y;
+	tvec[2] = transform.translation.z;
+
+	tf::Quaternion q;
+	tf::quaternionMsgToTF(transform.rotation, q);
+	tf::Vector3 axis = q.getAxis();
+	double angle = q.getAngle();
+	rvec[0] = axis.x() * angle;
+	rvec[1] = axis.y() * angle;
+	rvec[2] = axis.z() * angle;
+}
+
 inline void fillTranslation(geometry_msgs::Vector3& translation, const cv::Vec3d& tvec)
 {
 	translation.x = tvec[0];
@@ -131,6 +177,23 @@ inline void snapOrientation(geometry_msgs::Quaternion& to, const geometry_msgs::
 	tf::quaternionTFToMsg(_from, to); // set "from" to "to"
 }
 
+/* Look up transform waiting not longer than timeout; if max_age is not zero and the transform is not
+   available yet, use the latest one without waiting, if it's not older than max_age */
+inline geometry_msgs::TransformStamped lookupTransform(const tf2_ros::Buffer& buffer, const std::string& target,
+                                                       const std::string& source, const ros::Time& stamp,
+                                                       const ros::Duration& timeout, const ros::Duration& max_age)
+{
+	if (!max_age.isZero() && !buffer.canTransform(target, source, stamp, ros::Duration(0))) {
+		try {
+			geometry_msgs::TransformStamped latest = buffer.lookupTransform(target, source, ros::Time(0));
+			if (std::abs((stamp - latest.header.stamp).toSec()) <= max_age.toSec()) return latest;
+		} catch (const tf2::TransformException& e) {
+			// no transform at all, wait for it
+		}
+	}
+	return buffer.lookupTransform(target, source, stamp, timeout);
+}
+
 inline void transformToPose(const geometry_msgs::Transform& transform, geometry_msgs::Pose& pose)
 {
 	pose.position.x = transform.translation.x;
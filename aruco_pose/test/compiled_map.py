@@ -0,0 +1,51 @@
+import rospy
+import pytest
+
+import tf2_ros
+import tf2_geometry_msgs
+from geometry_msgs.msg import PoseWithCovarianceStamped
+from visualization_msgs.msg import MarkerArray as VisMarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+@pytest.fixture
+def tf_buffer():
+    buf = tf2_ros.Buffer()
+    tf2_ros.TransformListener(buf)
+    return buf
+
+def approx(expected):
+    return pytest.approx(expected, abs=1e-4) # compare floats more roughly
+
+def test_map(node):
+    # the compiled basic map should give the same pose as the text one
+    pose = rospy.wait_for_message('aruco_map/pose', PoseWithCovarianceStamped, timeout=5)
+    assert pose.header.frame_id == 'main_camera_optical'
+    assert pose.pose.pose.position.x == approx(-0.629167753342)
+    assert pose.pose.pose.position.y == approx(0.293822650809)
+    assert pose.pose.pose.position.z == approx(2.12641343155)
+    assert pose.pose.pose.orientation.x == approx(-0.998383794799)
+    assert pose.pose.pose.orientation.y == approx(-5.20919098575e-06)
+    assert pose.pose.pose.orientation.z == approx(-0.0300861070302)
+    assert pose.pose.pose.orientation.w == approx(0.0482143590507)
+
+def test_map_markers_frames(node, tf_buffer):
+    stamp = rospy.get_rostime()
+    timeout = rospy.Duration(5)
+
+    marker_4 = tf_buffer.lookup_transform('aruco_map', 'aruco_in_map_4', stamp, timeout)
+    assert marker_4.transform.translation.x == approx(1)
+    assert marker_4.transform.translation.y == approx(1)
+    assert marker_4.transform.translation.z == approx(0)
+
+    marker_12 = tf_buffer.lookup_transform('aruco_map', 'aruco_in_map_12', stamp, timeout)
+    assert marker_12.transform.translation.x == approx(0.2)
+    assert marker_12.transform.translation.y == approx(0.5)
+    assert marker_12.transform.translation.z == approx(0)
+
+def test_map_visualization(node):
+    vis = rospy.wait_for_message('aruco_map/visualization', VisMarkerArray, timeout=5)
+    assert len(vis.markers) == 7
@@ -0,0 +1,35 @@
+import rospy
+import pytest
+import numpy as np
+
+from geometry_msgs.msg import PoseWithCovarianceStamped
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def get_covariance(topic):
+    pose = rospy.wait_for_message(topic, PoseWithCovarianceStamped, timeout=5)
+    return np.array(pose.pose.covariance).reshape(6, 6)
+
+def test_covariance(node):
+    cov = get_covariance('aruco_map/pose')
+    assert np.all(np.diag(cov) > 0)
+    assert np.allclose(cov, cov.T, rtol=1e-6, atol=1e-12)
+    # positive semi-definite
+    assert np.all(np.linalg.eigvalsh(cov) > -1e-9 * np.max(np.diag(cov)))
+    # the map is 2 m away, so the position is known within centimeters
+    assert np.all(np.sqrt(np.diag(cov)[:3]) < 0.05)
+
+def test_covariance_min_error(node):
+    # the rendered image has almost no reprojection error, so the covariance scales with the squared min error
+    cov = get_covariance('aruco_map/pose')
+    rough = get_covariance('aruco_map_rough/pose')
+    assert np.allclose(rough, cov * 4, rtol=1e-3, atol=1e-12)
+
+def test_covariance_markers_count(node):
+    # the pose estimated from a single marker is less certain
+    cov = get_covariance('aruco_map/pose')
+    single = get_covariance('aruco_map_single/pose')
+    assert np.all(np.diag(single) > np.diag(cov))
@@ -0,0 +1,71 @@
+import os
+import rospy
+import rospkg
+import pytest
+import yaml
+import cv2
+import numpy as np
+
+from cv_bridge import CvBridge
+from sensor_msgs.msg import Image, CameraInfo
+from aruco_pose.msg import MarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def approx(expected):
+    return pytest.approx(expected, abs=0.2) # corners are refined on the full resolution image with 0.1 px accuracy
+
+def load_camera_info(path):
+    with open(path) as f:
+        calib = yaml.safe_load(f)
+    return CameraInfo(width=calib['image_width'], height=calib['image_height'],
+                      distortion_model=calib['distortion_model'],
+                      D=calib['distortion_coefficients']['data'], K=calib['camera_matrix']['data'],
+                      R=calib['rectification_matrix']['data'], P=calib['projection_matrix']['data'])
+
+def wait(condition, timeout=5):
+    deadline = rospy.get_time() + timeout
+    while not condition():
+        assert rospy.get_time() < deadline
+        rospy.sleep(0.01)
+
+def test_downscale(node):
+    path = os.path.join(rospkg.RosPack().get_path('aruco_pose'), 'test')
+    image = cv2.imread(os.path.join(path, 'map.png'), cv2.IMREAD_GRAYSCALE)
+    # move the image up, so that marker 3 is 3.6 px from the top border: that's farther than
+    # minDistanceToBorder (3 px) on the full resolution image, but closer on the half resolution one
+    image = cv2.warpAffine(image, np.float32([[1, 0, 0], [0, 1, -46]]), (image.shape[1], image.shape[0]),
+                           borderValue=255)
+
+    markers = {}
+    def callback(name):
+        return lambda msg: markers.__setitem__(name, msg)
+    subs = [rospy.Subscriber('aruco_detect/markers', MarkerArray, callback('scaled')),
+            rospy.Subscriber('aruco_detect_full/markers', MarkerArray, callback('full'))]
+    image_pub = rospy.Publisher('main_camera/image_raw', Image, queue_size=1)
+    info_pub = rospy.Publisher('main_camera/camera_info', CameraInfo, queue_size=1)
+    wait(lambda: image_pub.get_num_connections() > 0 and info_pub.get_num_connections() > 0 and
+         all(sub.get_num_connections() > 0 for sub in subs))
+
+    msg = CvBridge().cv2_to_imgmsg(image, 'mono8')
+    msg.header.stamp = rospy.Time.now()
+    msg.header.frame_id = 'main_camera_optical'
+    info = load_camera_info(os.path.join(path, 'camera_info.yaml'))
+    info.header = msg.header
+    info_pub.publish(info)
+    image_pub.publish(msg)
+    wait(lambda: len(markers) == 2)
+
+    full = {marker.id: marker for marker in markers['full'].markers}
+    scaled = {marker.id: marker for marker in markers['scaled'].markers}
+    assert sorted(full) == [1, 2, 3, 4, 100]
+    # markers are detected on the downscaled image
+    assert sorted(scaled) == [1, 2, 4, 100]
+
+    for id in scaled:
+        for corner in ('c1', 'c2', 'c3', 'c4'):
+            assert getattr(scaled[id], corner).x == approx(getattr(full[id], corner).x)
+            assert getattr(scaled[id], corner).y == approx(getattr(full[id], corner).y)
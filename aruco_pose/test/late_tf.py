@@ -0,0 +1,38 @@
+import rospy
+import pytest
+
+import tf2_ros
+from geometry_msgs.msg import TransformStamped
+from aruco_pose.msg import MarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+@pytest.fixture
+def late_tf(node):
+    # known tilt frame, flipped relative to the camera, with the stamps 0.2 s behind
+    br = tf2_ros.TransformBroadcaster()
+    transform = TransformStamped()
+    transform.header.frame_id = 'main_camera_optical'
+    transform.child_frame_id = 'known_tilt'
+    transform.transform.rotation.x = 1
+    def publish(event):
+        transform.header.stamp = rospy.get_rostime() - rospy.Duration(0.2)
+        br.sendTransform(transform)
+    timer = rospy.Timer(rospy.Duration(0.05), publish)
+    rospy.sleep(0.5)
+    yield
+    timer.shutdown()
+
+def test_late_tf(node, late_tf):
+    for _ in range(5):
+        markers = rospy.wait_for_message('aruco_detect/markers', MarkerArray, timeout=5)
+        # the latest transform is used without waiting for the frame stamp one
+        assert rospy.get_rostime() - markers.header.stamp < rospy.Duration(0.5)
+        assert len(markers.markers) == 5
+        for marker in markers.markers:
+            # snapped to the flipped frame: the rotation is around its x and y axes only
+            assert marker.pose.orientation.z == pytest.approx(0, abs=1e-6)
+            assert marker.pose.orientation.w == pytest.approx(0, abs=1e-6)
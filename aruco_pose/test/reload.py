@@ -0,0 +1,35 @@
+import rospy
+import pytest
+
+from geometry_msgs.msg import PoseWithCovarianceStamped
+from std_srvs.srv import Trigger
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def approx(expected):
+    return pytest.approx(expected, abs=1e-4) # compare floats more roughly
+
+def check_pose(pose):
+    assert pose.pose.pose.position.x == approx(-0.629167753342)
+    assert pose.pose.pose.position.y == approx(0.293822650809)
+    assert pose.pose.pose.position.z == approx(2.12641343155)
+    assert pose.pose.pose.orientation.x == approx(-0.998383794799)
+    assert pose.pose.pose.orientation.y == approx(-5.20919098575e-06)
+    assert pose.pose.pose.orientation.z == approx(-0.0300861070302)
+    assert pose.pose.pose.orientation.w == approx(0.0482143590507)
+
+def test_reload(node):
+    check_pose(rospy.wait_for_message('aruco_map/pose', PoseWithCovarianceStamped, timeout=5))
+
+    rospy.wait_for_service('aruco_map/reload', timeout=5)
+    reload = rospy.ServiceProxy('aruco_map/reload', Trigger)
+    res = reload()
+    assert res.success
+    assert res.message == 'added 0, changed 0, removed 0 markers'
+
+    # the unchanged map is not reloaded by the watch timer, and the pose stays the same
+    rospy.sleep(1)
+    check_pose(rospy.wait_for_message('aruco_map/pose', PoseWithCovarianceStamped, timeout=5))
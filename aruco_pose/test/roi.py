@@ -0,0 +1,63 @@
+import rospy
+import pytest
+
+from aruco_pose.msg import MarkerArray, Marker
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def test_predicted_markers(node):
+    # map's markers are projected to the image using the map pose
+    predicted = rospy.wait_for_message('aruco_map/predicted_markers', MarkerArray, timeout=5)
+    assert predicted.header.frame_id == 'main_camera_optical'
+    ids = [marker.id for marker in predicted.markers]
+    assert {1, 2, 3, 4} <= set(ids)
+    assert 100 not in ids
+    marker = predicted.markers[ids.index(2)]
+    assert marker.c1.x == pytest.approx(415.557739258, abs=1)
+    assert marker.c1.y == pytest.approx(335.557739258, abs=1)
+    assert marker.c3.x == pytest.approx(509.442260742, abs=1)
+    assert marker.c3.y == pytest.approx(429.442260742, abs=1)
+
+def test_roi_detection(node):
+    # predict marker 2 only
+    predicted = MarkerArray()
+    predicted.header.frame_id = 'main_camera_optical'
+    marker = Marker(id=2, length=0.33)
+    marker.c1.x, marker.c1.y = 415, 335
+    marker.c2.x, marker.c2.y = 509, 335
+    marker.c3.x, marker.c3.y = 509, 429
+    marker.c4.x, marker.c4.y = 415, 429
+    predicted.markers.append(marker)
+    pub = rospy.Publisher('predicted_markers', MarkerArray, queue_size=1)
+
+    def publish_predicted(event):
+        predicted.header.stamp = rospy.Time.now()
+        pub.publish(predicted)
+    timer = rospy.Timer(rospy.Duration(0.05), publish_predicted)
+
+    frames = []
+    def markers_callback(msg):
+        frames.append(sorted(marker.id for marker in msg.markers))
+    rospy.wait_for_message('aruco_detect/markers', MarkerArray, timeout=5)
+    rospy.sleep(0.5) # let the prediction arrive
+    sub = rospy.Subscriber('aruco_detect/markers', MarkerArray, markers_callback)
+    rospy.sleep(1.5)
+    sub.unregister()
+    timer.shutdown()
+
+    # markers are detected in the predicted regions only, except for full-frame detection every 4th frame
+    assert len(frames) >= 8
+    assert set(map(tuple, frames)) == {(2,), (1, 2, 3, 4, 100)}
+    full = [i for i, ids in enumerate(frames) if len(ids) == 5]
+    assert all(b - a == 4 for a, b in zip(full, full[1:]))
+
+    # corners in the regions are refined as usual
+    markers = rospy.wait_for_message('aruco_detect/markers', MarkerArray, timeout=5)
+    marker = next(marker for marker in markers.markers if marker.id == 2)
+    assert marker.c1.x == pytest.approx(415.557739258, abs=1e-2)
+    assert marker.c1.y == pytest.approx(335.557739258, abs=1e-2)
+    assert marker.c3.x == pytest.approx(509.442260742, abs=1e-2)
+    assert marker.c3.y == pytest.approx(429.442260742, abs=1e-2)
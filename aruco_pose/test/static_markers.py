@@ -0,0 +1,44 @@
+import rospy
+import pytest
+
+import tf2_ros
+from tf2_msgs.msg import TFMessage
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+@pytest.fixture
+def tf_buffer():
+    buf = tf2_ros.Buffer()
+    tf2_ros.TransformListener(buf)
+    return buf
+
+def approx(expected):
+    return pytest.approx(expected, abs=1e-4) # compare floats more roughly
+
+def test_static_frames(node, tf_buffer):
+    # a late subscriber gets both maps' frames from the latched message
+    timeout = rospy.Duration(5)
+    marker_2 = tf_buffer.lookup_transform('aruco_map_a', 'aruco_2', rospy.Time(), timeout)
+    assert marker_2.transform.translation.x == approx(1)
+    assert marker_2.transform.translation.y == approx(0)
+    marker_3 = tf_buffer.lookup_transform('aruco_map_b', 'aruco_3', rospy.Time(), timeout)
+    assert marker_3.transform.translation.x == approx(0)
+    assert marker_3.transform.translation.y == approx(1)
+    marker_4 = tf_buffer.lookup_transform('aruco_map_b', 'aruco_4', rospy.Time(), timeout)
+    assert marker_4.transform.translation.x == approx(1)
+    assert marker_4.transform.translation.y == approx(1)
+
+def test_detected_frames(node):
+    # aruco_detect sends frames only for markers, which are in none of the maps
+    rospy.sleep(1)
+    frames = set()
+    def callback(msg):
+        frames.update(t.child_frame_id for t in msg.transforms if t.header.frame_id == 'main_camera_optical')
+    sub = rospy.Subscriber('/tf', TFMessage, callback)
+    rospy.sleep(2)
+    sub.unregister()
+    assert frames >= {'aruco_1', 'aruco_100'}
+    assert not frames & {'aruco_2', 'aruco_3', 'aruco_4'}
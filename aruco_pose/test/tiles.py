@@ -0,0 +1,96 @@
+import os
+import rospy
+import rospkg
+import pytest
+import yaml
+import cv2
+
+from cv_bridge import CvBridge
+from geometry_msgs.msg import PoseWithCovarianceStamped
+from sensor_msgs.msg import Image, CameraInfo
+from aruco_pose.msg import MarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def approx(expected):
+    return pytest.approx(expected, abs=1e-3) # corners are refined within the tiles
+
+def load_camera_info(path):
+    with open(path) as f:
+        calib = yaml.safe_load(f)
+    return CameraInfo(width=calib['image_width'], height=calib['image_height'],
+                      distortion_model=calib['distortion_model'],
+                      D=calib['distortion_coefficients']['data'], K=calib['camera_matrix']['data'],
+                      R=calib['rectification_matrix']['data'], P=calib['projection_matrix']['data'])
+
+def wait(condition, timeout=5):
+    deadline = rospy.get_time() + timeout
+    while not condition():
+        assert rospy.get_time() < deadline
+        rospy.sleep(0.01)
+
+def center(marker):
+    return ((marker.c1.x + marker.c2.x + marker.c3.x + marker.c4.x) / 4,
+            (marker.c1.y + marker.c2.y + marker.c3.y + marker.c4.y) / 4)
+
+def test_markers(node):
+    # markers in the overlapping regions are reported once
+    markers = rospy.wait_for_message('aruco_detect/markers', MarkerArray, timeout=5)
+    assert sorted(marker.id for marker in markers.markers) == [1, 2, 3, 4, 100]
+
+def test_full_scale(node):
+    # markers not fitting in the tiles overlap are found on the downscaled whole image
+    tiles = rospy.wait_for_message('aruco_detect_tiles_only/markers', MarkerArray, timeout=5)
+    assert tiles.markers == []
+
+    markers = rospy.wait_for_message('aruco_detect_small_overlap/markers', MarkerArray, timeout=5)
+    assert sorted(marker.id for marker in markers.markers) == [1, 2, 3, 4, 100]
+    marker_2 = next(marker for marker in markers.markers if marker.id == 2)
+    # corners are refined on the full resolution image
+    assert marker_2.c1.x == pytest.approx(415.557739258, abs=0.2)
+    assert marker_2.c1.y == pytest.approx(335.557739258, abs=0.2)
+    assert marker_2.c3.x == pytest.approx(509.442260742, abs=0.2)
+    assert marker_2.c3.y == pytest.approx(429.442260742, abs=0.2)
+
+def test_repeated_id(node):
+    # copy marker 2 to the image center, where it's in all the four tiles
+    path = os.path.join(rospkg.RosPack().get_path('aruco_pose'), 'test')
+    image = cv2.imread(os.path.join(path, 'map.png'), cv2.IMREAD_GRAYSCALE)
+    image[185:300, 262:377] = image[325:440, 405:520]
+
+    markers = []
+    sub = rospy.Subscriber('aruco_detect_repeated/markers', MarkerArray, markers.append)
+    image_pub = rospy.Publisher('repeated_camera/image_raw', Image, queue_size=1)
+    info_pub = rospy.Publisher('repeated_camera/camera_info', CameraInfo, queue_size=1)
+    wait(lambda: image_pub.get_num_connections() > 0 and info_pub.get_num_connections() > 0 and
+         sub.get_num_connections() > 0)
+
+    msg = CvBridge().cv2_to_imgmsg(image, 'mono8')
+    msg.header.stamp = rospy.Time.now()
+    msg.header.frame_id = 'main_camera_optical'
+    info = load_camera_info(os.path.join(path, 'camera_info.yaml'))
+    info.header = msg.header
+    info_pub.publish(info)
+    image_pub.publish(msg)
+    wait(lambda: len(markers) > 0)
+
+    # both markers 2 are reported, each of them once
+    assert sorted(marker.id for marker in markers[0].markers) == [1, 2, 2, 3, 4, 100]
+    centers = sorted(center(marker) for marker in markers[0].markers if marker.id == 2)
+    assert centers[0][0] == pytest.approx(319.5, abs=0.5)
+    assert centers[0][1] == pytest.approx(242.5, abs=0.5)
+    assert centers[1][0] == pytest.approx(462.5, abs=0.5)
+    assert centers[1][1] == pytest.approx(382.5, abs=0.5)
+
+def test_map(node):
+    pose = rospy.wait_for_message('aruco_map/pose', PoseWithCovarianceStamped, timeout=5)
+    assert pose.pose.pose.position.x == approx(-0.629167753342)
+    assert pose.pose.pose.position.y == approx(0.293822650809)
+    assert pose.pose.pose.position.z == approx(2.12641343155)
+    assert pose.pose.pose.orientation.x == approx(-0.998383794799)
+    assert pose.pose.pose.orientation.y == approx(-5.20919098575e-06)
+    assert pose.pose.pose.orientation.z == approx(-0.0300861070302)
+    assert pose.pose.pose.orientation.w == approx(0.0482143590507)
@@ -0,0 +1,85 @@
+import os
+import rospy
+import rospkg
+import pytest
+import yaml
+import cv2
+import numpy as np
+
+from cv_bridge import CvBridge
+from sensor_msgs.msg import Image, CameraInfo
+from aruco_pose.msg import MarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def approx(expected):
+    return pytest.approx(expected, abs=0.2) # corners are refined with 0.1 px accuracy
+
+class Camera(object):
+    # Publishes frames one by one, waiting for the markers detected on each of them
+
+    def __init__(self):
+        path = os.path.join(rospkg.RosPack().get_path('aruco_pose'), 'test')
+        self.image = cv2.imread(os.path.join(path, 'map.png'), cv2.IMREAD_GRAYSCALE)
+        with open(os.path.join(path, 'camera_info.yaml')) as f:
+            calib = yaml.safe_load(f)
+        self.info = CameraInfo(width=calib['image_width'], height=calib['image_height'],
+                               distortion_model=calib['distortion_model'],
+                               D=calib['distortion_coefficients']['data'], K=calib['camera_matrix']['data'],
+                               R=calib['rectification_matrix']['data'], P=calib['projection_matrix']['data'])
+        self.bridge = CvBridge()
+        self.markers = {}
+        self.image_pub = rospy.Publisher('main_camera/image_raw', Image, queue_size=1)
+        self.info_pub = rospy.Publisher('main_camera/camera_info', CameraInfo, queue_size=1)
+        self.markers_sub = rospy.Subscriber('aruco_detect/markers', MarkerArray, self.markers_callback)
+        self.wait(lambda: self.image_pub.get_num_connections() > 0 and self.info_pub.get_num_connections() > 0 and
+                  self.markers_sub.get_num_connections() > 0)
+
+    def markers_callback(self, msg):
+        self.markers[msg.header.stamp] = msg
+
+    def wait(self, condition, timeout=5):
+        deadline = rospy.get_time() + timeout
+        while not condition():
+            assert rospy.get_time() < deadline
+            rospy.sleep(0.01)
+
+    def shifted(self, x, y):
+        m = np.float32([[1, 0, x], [0, 1, y]])
+        return cv2.warpAffine(self.image, m, (self.image.shape[1], self.image.shape[0]), borderValue=255)
+
+    def publish(self, image):
+        msg = self.bridge.cv2_to_imgmsg(image, 'mono8')
+        msg.header.stamp = rospy.Time.now()
+        msg.header.frame_id = 'main_camera_optical'
+        self.info.header = msg.header
+        self.info_pub.publish(self.info)
+        self.image_pub.publish(msg)
+        self.wait(lambda: msg.header.stamp in self.markers)
+        return self.markers[msg.header.stamp]
+
+def test_tracking(node):
+    camera = Camera()
+    frames = []
+    for i in range(10):
+        # the image moves by (2, 1) px every frame
+        image = camera.shifted(2 * i, i)
+        if i == 0:
+            image[320:445, 400:525] = 255 # cover marker 2 on the first keyframe
+        frames.append(camera.publish(image))
+
+    ids = [sorted(marker.id for marker in frame.markers) for frame in frames]
+    # markers of the keyframe are tracked, marker 2 is only found on the next keyframe
+    assert ids[:5] == [[1, 3, 4, 100]] * 5
+    assert ids[5:] == [[1, 2, 3, 4, 100]] * 5
+
+    # tracked corners follow the image
+    for i, frame in enumerate(frames):
+        marker = next(marker for marker in frame.markers if marker.id == 3)
+        assert marker.c1.x == approx(129.557723999 + 2 * i)
+        assert marker.c1.y == approx(49.557723999 + i)
+        assert marker.c3.x == approx(223.442276001 + 2 * i)
+        assert marker.c3.y == approx(143.442276001 + i)
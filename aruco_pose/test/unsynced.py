@@ -0,0 +1,52 @@
+import rospy
+import rosgraph
+import pytest
+
+from geometry_msgs.msg import PoseWithCovarianceStamped
+from sensor_msgs.msg import Image
+from aruco_pose.msg import MarkerArray
+
+
+@pytest.fixture
+def node():
+    return rospy.init_node('aruco_pose_test', anonymous=True)
+
+def approx(expected):
+    return pytest.approx(expected, abs=1e-4) # compare floats more roughly
+
+def image_subscribed():
+    _, subscribers, _ = rosgraph.Master(rospy.get_name()).getSystemState()
+    return '/map_manager' in dict(subscribers).get('/main_camera/image_raw', [])
+
+def wait(condition, timeout=5):
+    deadline = rospy.get_time() + timeout
+    while not condition():
+        assert rospy.get_time() < deadline
+        rospy.sleep(0.1)
+
+def test_map(node):
+    # markers are paired with the last camera info, without the image
+    markers = rospy.wait_for_message('aruco_detect/markers', MarkerArray, timeout=5)
+    pose = rospy.wait_for_message('aruco_map/pose', PoseWithCovarianceStamped, timeout=5)
+    assert not image_subscribed()
+    assert pose.header.frame_id == 'main_camera_optical'
+    assert pose.header.stamp >= markers.header.stamp
+    assert pose.pose.pose.position.x == approx(-0.629167753342)
+    assert pose.pose.pose.position.y == approx(0.293822650809)
+    assert pose.pose.pose.position.z == approx(2.12641343155)
+    assert pose.pose.pose.orientation.x == approx(-0.998383794799)
+    assert pose.pose.pose.orientation.y == approx(-5.20919098575e-06)
+    assert pose.pose.pose.orientation.z == approx(-0.0300861070302)
+    assert pose.pose.pose.orientation.w == approx(0.0482143590507)
+
+def test_map_debug(node):
+    # the image is subscribed while the debug image has subscribers
+    images = []
+    sub = rospy.Subscriber('aruco_map/debug', Image, images.append)
+    wait(lambda: len(images) > 0)
+    assert image_subscribed()
+    assert images[0].width == 640
+    assert images[0].height == 480
+
+    sub.unregister()
+    wait(lambda: not image_subscribed())
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_list_macros.h>
 #include <image_transport/image_transport.h>
@@ -28,8 +29,19 @@
 #include <geometry_msgs/PointStamped.h>
 #include <geometry_msgs/TwistStamped.h>
 
+#include "phase_correlation.h"
+
 using cv::Mat;
 
+struct FlowRegion
+{
+	cv::Rect rect;
+	PhaseCorrelator correlator;
+	cv::Point2d shift;
+	double response = 0;
+	bool inlier = false;
+};
+
 class OpticalFlow : public nodelet::Nodelet
 {
 public:
@@ -41,18 +53,34 @@ public:
 
 private:
 	ros::Publisher flow_pub_, velo_pub_, shift_pub_;
-	ros::Time prev_stamp_;
+	ros::Time prev_stamp_, last_frame_stamp_;
 	std::string fcu_frame_id_, local_frame_id_;
 	image_transport::CameraSubscriber img_sub_;
 	image_transport::Publisher img_pub_;
 	mavros_msgs::OpticalFlowRad flow_;
-	int roi_, roi_2_;
-	Mat hann_;
-	Mat prev_, curr_;
+	int roi_, roi_2_, grid_, pyramid_;
+	bool fixed_point_;
+	double outlier_threshold_, pyramid_min_response_;
+	PhaseCorrelator correlator_, coarse_correlator_;
+	std::vector<Mat> pyramid_images_;
+	Mat shifted_spectrum_;
+	std::vector<FlowRegion> regions_;
+	cv::Size regions_image_size_;
 	Mat camera_matrix_, dist_coeffs_;
+	sensor_msgs::CameraInfoConstPtr cinfo_;
 	tf2_ros::Buffer tf_buffer_;
 	tf2_ros::TransformListener tf_listener_;
 	bool calc_flow_gyro_;
+	double keyframe_threshold_, max_load_;
+	ros::Duration publish_period_;
+	cv::Point2d keyframe_shift_; // shift already reported since the keyframe
+	double frame_interval_ = 0, processing_time_ = 0;
+	int skip_ = 0, skipped_ = 0;
+	// flow integrated since the last publishing
+	double integrated_x_ = 0, integrated_y_ = 0, integrated_xgyro_ = 0, integrated_ygyro_ = 0, integrated_zgyro_ = 0;
+	double quality_sum_ = 0;
+	int integrated_frames_ = 0;
+	ros::Duration integration_time_;
 
 	void onInit()
 	{
@@ -65,7 +93,29 @@ private:
 		nh.param<std::string>("mavros/local_position/tf/child_frame_id", fcu_frame_id_, "base_link");
 		nh_priv.param("roi", roi_, 128);
 		roi_2_ = roi_ / 2;
+		nh_priv.param("grid", grid_, 1);
+		if (grid_ < 1) {
+			ROS_WARN("optical_flow: grid should be positive, using 1");
+			grid_ = 1;
+		}
+		nh_priv.param("outlier_threshold", outlier_threshold_, 1.0);
+		if (roi_ == 0) grid_ = 1; // regions require ROI size
+		nh_priv.param("pyramid", pyramid_, 0);
+		if (pyramid_ < 0) {
+			ROS_WARN("optical_flow: pyramid should not be negative, using 0");
+			pyramid_ = 0;
+		}
+		nh_priv.param("pyramid_min_response", pyramid_min_response_, 0.1);
+		if (roi_ == 0 || grid_ != 1) pyramid_ = 0; // pyramid is used for the single ROI only
+		pyramid_images_.resize(pyramid_);
+		nh_priv.param("fixed_point", fixed_point_, false);
+		correlator_.setFixedPoint(fixed_point_);
+		coarse_correlator_.setFixedPoint(fixed_point_);
 		nh_priv.param("calc_flow_gyro", calc_flow_gyro_, false);
+		nh_priv.param("keyframe_threshold", keyframe_threshold_, 0.0);
+		nh_priv.param("max_load", max_load_, 0.0);
+		double publish_rate = nh_priv.param("publish_rate", 0.0);
+		publish_period_ = ros::Duration(publish_rate > 0 ? 1 / publish_rate : 0);
 
 		img_sub_ = it.subscribeCamera("image_raw", 1, &OpticalFlow::flow, this);
 		img_pub_ = it_priv.advertise("debug", 1);
@@ -84,6 +134,12 @@ private:
 	}
 
 	void parseCameraInfo(const sensor_msgs::CameraInfoConstPtr &cinfo) {
+		// parse only when the calibration changes
+		if (cinfo_ && cinfo->K == cinfo_->K && cinfo->D == cinfo_->D) return;
+		cinfo_ = cinfo;
+
+		dist_coeffs_.create(std::max<int>(8, cinfo->D.size()), 1, CV_64F); // up to 14 coefficients
+		dist_coeffs_.setTo(0);
 		for (int i = 0; i < 3; ++i) {
 			for (int j = 0; j < 3; ++j) {
 				camera_matrix_.at<double>(i, j) = cinfo->K[3 * i + j];
@@ -94,6 +150,170 @@ private:
 		}
 	}
 
+	// Shift of the point in pixels with the distortion removed
+	cv::Point2d undistortShift(const cv::Point2d& point, const cv::Point2d& shift) const
+	{
+		std::vector<cv::Point2d> points_dist = { point, point + shift };
+		std::vector<cv::Point2d> points_undist(2);
+		cv::undistortPoints(points_dist, points_undist, camera_matrix_, dist_coeffs_, cv::noArray(), camera_matrix_);
+		return points_undist[1] - points_undist[0];
+	}
+
+	// Calculate the image shift relative to the previous frame; returns false on the first frame.
+	// Shifts of the regions are undistorted, as they are far from the image center.
+	bool calcShift(const Mat& img, cv::Point2d& shift, double& response)
+	{
+		if (grid_ == 1) {
+			correlator_.setCurrent(img);
+			if (!correlator_.hasPrevious()) return false;
+			shift = correlator_.correlate(&response);
+			return true;
+		}
+
+		initRegions(img.size());
+		cv::parallel_for_(cv::Range(0, regions_.size()), [&](const cv::Range& range) {
+			for (int i = range.start; i < range.end; i++) {
+				FlowRegion& region = regions_[i];
+				region.correlator.setCurrent(img(region.rect));
+				if (region.correlator.hasPrevious()) {
+					cv::Point2d center(region.rect.x + region.rect.width / 2.0, region.rect.y + region.rect.height / 2.0);
+					region.shift = undistortShift(center, region.correlator.correlate(&region.response));
+				}
+			}
+		});
+		if (!regions_[0].correlator.hasPrevious()) return false;
+		fuseRegions(shift, response);
+		return true;
+	}
+
+	// Estimate the shift on the downsampled region of ROI size << pyramid levels first, then refine it
+	// correlating the previous ROI with the current one offset by the coarse shift.
+	// The single level shift is used, if the coarse response is low or lower than the single level one.
+	bool calcPyramidShift(const Mat& frame, cv::Point2d& shift, double& response)
+	{
+		int scale = 1 << pyramid_;
+		cv::Rect roi(frame.cols / 2 - roi_2_, frame.rows / 2 - roi_2_, roi_, roi_);
+		correlator_.setCurrent(frame(roi));
+
+		int coarse_w = std::min(roi_ * scale, frame.cols), coarse_h = std::min(roi_ * scale, frame.rows);
+		Mat coarse = frame(cv::Rect((frame.cols - coarse_w) / 2, (frame.rows - coarse_h) / 2, coarse_w, coarse_h));
+		for (auto& level : pyramid_images_) {
+			cv::pyrDown(coarse, level);
+			coarse = level;
+		}
+		coarse_correlator_.setCurrent(coarse);
+		if (!coarse_correlator_.hasPrevious()) return false;
+
+		double coarse_response;
+		cv::Point2d coarse_shift = coarse_correlator_.correlate(&coarse_response) * scale;
+		cv::Rect shifted = roi + cv::Point(cvRound(coarse_shift.x), cvRound(coarse_shift.y));
+		shifted.x = std::max(0, std::min(shifted.x, frame.cols - roi.width));
+		shifted.y = std::max(0, std::min(shifted.y, frame.rows - roi.height));
+
+		shift = correlator_.correlate(&response);
+		if (shifted == roi || coarse_response < pyramid_min_response_ || coarse_response < response) {
+			return true;
+		}
+		correlator_.transform(frame(shifted), shifted_spectrum_);
+		shift = correlator_.correlate(correlator_.previous(), shifted_spectrum_, &response);
+		shift += cv::Point2d(shifted.tl() - roi.tl());
+		return true;
+	}
+
+	// Place grid x grid regions of ROI size evenly over the image
+	void initRegions(cv::Size size)
+	{
+		if (size == regions_image_size_) return;
+		regions_image_size_ = size;
+		regions_.clear();
+		regions_.resize(grid_ * grid_);
+		int roi_w = std::min(roi_, size.width), roi_h = std::min(roi_, size.height);
+		for (int y = 0; y < grid_; y++) {
+			for (int x = 0; x < grid_; x++) {
+				int cx = (x * 2 + 1) * size.width / (grid_ * 2);
+				int cy = (y * 2 + 1) * size.height / (grid_ * 2);
+				cv::Rect rect(cx - roi_w / 2, cy - roi_h / 2, roi_w, roi_h);
+				rect.x = std::max(0, std::min(rect.x, size.width - roi_w));
+				rect.y = std::max(0, std::min(rect.y, size.height - roi_h));
+				regions_[y * grid_ + x].rect = rect;
+				regions_[y * grid_ + x].correlator.setFixedPoint(fixed_point_);
+			}
+		}
+	}
+
+	// Reject regions, which shifts are far from the median, and average the rest weighted by response.
+	// Quality is the mean response of inliers scaled by the share of inliers.
+	void fuseRegions(cv::Point2d& shift, double& quality)
+	{
+		std::vector<double> xs, ys, deviations;
+		for (auto const& region : regions_) {
+			xs.push_back(region.shift.x);
+			ys.push_back(region.shift.y);
+		}
+		cv::Point2d center(median(xs), median(ys));
+		for (auto const& region : regions_) {
+			deviations.push_back(cv::norm(region.shift - center));
+		}
+		// median absolute deviation, scaled to be consistent with the standard deviation
+		double threshold = std::max(3 * 1.4826 * median(deviations), outlier_threshold_);
+
+		double weight = 0, response = 0;
+		shift = cv::Point2d(0, 0);
+		for (auto& region : regions_) {
+			region.inlier = cv::norm(region.shift - center) <= threshold;
+			if (!region.inlier) continue;
+			double w = std::max(region.response, 1e-6);
+			shift += region.shift * w;
+			weight += w;
+			response += region.response;
+		}
+		shift /= weight; // there is always at least one inlier
+		quality = std::min(1.0, response / regions_.size());
+	}
+
+	static double median(std::vector<double> values)
+	{
+		std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+		return values[values.size() / 2];
+	}
+
+	void nextFrame()
+	{
+		keyframe_shift_ = cv::Point2d(0, 0);
+		correlator_.next();
+		coarse_correlator_.next();
+		for (auto& region : regions_) {
+			region.correlator.next();
+		}
+	}
+
+	void resetFrame()
+	{
+		keyframe_shift_ = cv::Point2d(0, 0);
+		resetIntegration();
+		correlator_.reset();
+		coarse_correlator_.reset();
+		for (auto& region : regions_) {
+			region.correlator.reset();
+		}
+	}
+
+	void resetIntegration()
+	{
+		integrated_x_ = integrated_y_ = 0;
+		integrated_xgyro_ = integrated_ygyro_ = integrated_zgyro_ = 0;
+		integration_time_ = ros::Duration(0);
+		quality_sum_ = 0;
+		integrated_frames_ = 0;
+	}
+
+	void drawRegions(Mat& frame) const
+	{
+		for (auto const& region : regions_) {
+			cv::rectangle(frame, region.rect, cv::Scalar(region.inlier ? 255 : 0), 1);
+		}
+	}
+
 	void drawFlow(Mat& frame, double x, double y, double quality) const
 	{
 		double brightness = (1 - quality) * 25;;
@@ -107,26 +327,58 @@ private:
 	}
 
 	void flow(const sensor_msgs::ImageConstPtr& msg, const sensor_msgs::CameraInfoConstPtr& cinfo)
+	{
+		if (max_load_ <= 0) {
+			process(msg, cinfo);
+			return;
+		}
+
+		// Skip frames, if processing takes more than max_load of the camera frames interval
+		if (!last_frame_stamp_.isZero() && msg->header.stamp > last_frame_stamp_) {
+			double interval = (msg->header.stamp - last_frame_stamp_).toSec();
+			frame_interval_ = frame_interval_ == 0 ? interval : frame_interval_ * 0.9 + interval * 0.1;
+		}
+		last_frame_stamp_ = msg->header.stamp;
+		if (skipped_ < skip_) {
+			skipped_++;
+			return;
+		}
+		skipped_ = 0;
+
+		auto start = ros::WallTime::now();
+		process(msg, cinfo);
+		double time = (ros::WallTime::now() - start).toSec();
+		processing_time_ = processing_time_ == 0 ? time : processing_time_ * 0.9 + time * 0.1;
+
+		if (frame_interval_ > 0) {
+			skip_ = std::max(0, (int)std::ceil(processing_time_ / (max_load_ * frame_interval_)) - 1);
+		}
+	}
+
+	void process(const sensor_msgs::ImageConstPtr& msg, const sensor_msgs::CameraInfoConstPtr& cinfo)
 	{
 		parseCameraInfo(cinfo);
 
-		auto img = cv_bridge::toCvShare(msg, "mono8")->image;
+		auto frame = cv_bridge::toCvShare(msg, "mono8")->image;
+		auto img = frame;
 
 		// Apply ROI
-		if (roi_ != 0) {
+		if (roi_ != 0 && grid_ == 1) {
 			img = img(cv::Rect((msg->width / 2 - roi_2_), (msg->height / 2 - roi_2_), roi_, roi_));
 		}
 
-		img.convertTo(curr_, CV_32F);
+		cv::Point2d shift;
+		double response;
+		bool shifted = pyramid_ > 0 ? calcPyramidShift(frame, shift, response) : calcShift(img, shift, response);
 
-		if (prev_.empty()) {
-			prev_ = curr_.clone();
+		if (!shifted) {
+			nextFrame();
 			prev_stamp_ = msg->header.stamp;
-			cv::createHanningWindow(hann_, curr_.size(), CV_32F);
 
 		} else {
-			double response;
-			cv::Point2d shift = cv::phaseCorrelate(prev_, curr_, hann_, &response);
+			// Shift since the previous frame, when correlating against a keyframe
+			cv::Point2d total_shift = shift;
+			shift -= keyframe_shift_;
 
 			// Publish raw shift in pixels
 			static geometry_msgs::Vector3Stamped shift_vec;
@@ -136,24 +388,14 @@ private:
 			shift_vec.vector.y = shift.y;
 			shift_pub_.publish(shift_vec);
 
-			// Undistort flow in pixels
-			uint32_t flow_center_x = msg->width / 2;
-			uint32_t flow_center_y = msg->height / 2;
-			shift.x += flow_center_x;
-			shift.y += flow_center_y;
-
-			std::vector<cv::Point2d> points_dist = { shift };
-			std::vector<cv::Point2d> points_undist(1);
-
-			cv::undistortPoints(points_dist, points_undist, camera_matrix_, dist_coeffs_, cv::noArray(), camera_matrix_);
-			points_undist[0].x -= flow_center_x;
-			points_undist[0].y -= flow_center_y;
+			// Undistort flow in pixels (shifts of the regions are undistorted already)
+			cv::Point2d shift_undist = grid_ == 1 ? undistortShift(cv::Point2d(msg->width / 2, msg->height / 2), shift) : shift;
 
 			// Calculate flow in radians
 			double focal_length_x = camera_matrix_.at<double>(0, 0);
 			double focal_length_y = camera_matrix_.at<double>(1, 1);
-			double flow_x = atan2(points_undist[0].x, focal_length_x);
-			double flow_y = atan2(points_undist[0].y, focal_length_y);
+			double flow_x = atan2(shift_undist.x, focal_length_x);
+			double flow_y = atan2(shift_undist.y, focal_length_y);
 
 			// // Convert to FCU frame
 			static geometry_msgs::Vector3Stamped flow_camera, flow_fcu;
@@ -170,34 +412,49 @@ private:
 
 			// Calculate integration time
 			ros::Duration integration_time = msg->header.stamp - prev_stamp_;
-			uint32_t integration_time_us = integration_time.toSec() * 1.0e6;
 
 			if (calc_flow_gyro_) {
 				try {
 					auto flow_gyro_camera = calcFlowGyro(msg->header.frame_id, prev_stamp_, msg->header.stamp);
 					static geometry_msgs::Vector3Stamped flow_gyro_fcu;
 					tf_buffer_.transform(flow_gyro_camera, flow_gyro_fcu, fcu_frame_id_);
-					flow_.integrated_xgyro = flow_gyro_fcu.vector.x;
-					flow_.integrated_ygyro = flow_gyro_fcu.vector.y;
-					flow_.integrated_zgyro = flow_gyro_fcu.vector.z;
+					integrated_xgyro_ += flow_gyro_fcu.vector.x;
+					integrated_ygyro_ += flow_gyro_fcu.vector.y;
+					integrated_zgyro_ += flow_gyro_fcu.vector.z;
 				} catch (const tf2::TransformException& e) {
 					// Invalidate previous frame
-					prev_.release();
+					resetFrame();
 					return;
 				}
 			}
 
+			// Integrate flow in fcu frame
+			integrated_x_ += flow_fcu.vector.x;
+			integrated_y_ += flow_fcu.vector.y;
+			integration_time_ += integration_time;
+			quality_sum_ += response;
+			integrated_frames_++;
+
 			// Publish flow in fcu frame
-			flow_.header.stamp = /*prev_stamp_*/ msg->header.stamp;
-			flow_.integration_time_us = integration_time_us;
-			flow_.integrated_x = flow_fcu.vector.x;
-			flow_.integrated_y = flow_fcu.vector.y;
-			flow_.quality = (uint8_t)(response * 255);
-			flow_pub_.publish(flow_);
+			if (integration_time_ >= publish_period_) {
+				flow_.header.stamp = /*prev_stamp_*/ msg->header.stamp;
+				flow_.integration_time_us = integration_time_.toSec() * 1.0e6;
+				flow_.integrated_x = integrated_x_;
+				flow_.integrated_y = integrated_y_;
+				if (calc_flow_gyro_) {
+					flow_.integrated_xgyro = integrated_xgyro_;
+					flow_.integrated_ygyro = integrated_ygyro_;
+					flow_.integrated_zgyro = integrated_zgyro_;
+				}
+				flow_.quality = (uint8_t)(std::min(1.0, quality_sum_ / integrated_frames_) * 255); // response may slightly exceed 1
+				flow_pub_.publish(flow_);
+				resetIntegration();
+			}
 
 			// Publish debug image
 			if (img_pub_.getNumSubscribers() > 0) {
 				// publish debug image
+				drawRegions(img);
 				drawFlow(img, shift_vec.vector.x, shift_vec.vector.y, response);
 				cv_bridge::CvImage out_msg;
 				out_msg.header.frame_id = msg->header.frame_id;
@@ -211,11 +468,16 @@ private:
 			static geometry_msgs::TwistStamped velo;
 			velo.header.stamp = msg->header.stamp;
 			velo.header.frame_id = fcu_frame_id_;
-			velo.twist.angular.x = flow_.integrated_x / integration_time.toSec();
-			velo.twist.angular.y = flow_.integrated_y / integration_time.toSec();
+			velo.twist.angular.x = flow_fcu.vector.x / integration_time.toSec();
+			velo.twist.angular.y = flow_fcu.vector.y / integration_time.toSec();
 			velo_pub_.publish(velo);
 
-			prev_ = curr_.clone();
+			// Keep correlating against the keyframe while the motion is small
+			if (keyframe_threshold_ > 0 && cv::norm(total_shift) < keyframe_threshold_) {
+				keyframe_shift_ = total_shift;
+			} else {
+				nextFrame();
+			}
 			prev_stamp_ = msg->header.stamp;
 		}
 	}
@@ -0,0 +1,187 @@
+/*
+ * Phase correlation with reuse of the reference frame spectrum
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <cmath>
+#include <cfloat>
+#include <opencv2/core/hal/intrin.hpp>
+#include "phase_correlation.h"
+
+// Convert mono8 image to float and multiply by the window in one pass
+static void applyWindow(const cv::Mat& image, const cv::Mat& window, cv::Mat& dst)
+{
+	for (int y = 0; y < image.rows; y++) {
+		const uchar *src = image.ptr<uchar>(y);
+		const float *win = window.ptr<float>(y);
+		float *out = dst.ptr<float>(y);
+		int x = 0;
+#if CV_SIMD128
+		// NEON or SSE, depending on the platform
+		for (; x <= image.cols - 16; x += 16) {
+			cv::v_uint16x8 w0, w1;
+			cv::v_uint32x4 d0, d1, d2, d3;
+			cv::v_expand(cv::v_load(src + x), w0, w1);
+			cv::v_expand(w0, d0, d1);
+			cv::v_expand(w1, d2, d3);
+			cv::v_store(out + x, cv::v_cvt_f32(cv::v_reinterpret_as_s32(d0)) * cv::v_load(win + x));
+			cv::v_store(out + x + 4, cv::v_cvt_f32(cv::v_reinterpret_as_s32(d1)) * cv::v_load(win + x + 4));
+			cv::v_store(out + x + 8, cv::v_cvt_f32(cv::v_reinterpret_as_s32(d2)) * cv::v_load(win + x + 8));
+			cv::v_store(out + x + 12, cv::v_cvt_f32(cv::v_reinterpret_as_s32(d3)) * cv::v_load(win + x + 12));
+		}
+#endif
+		for (; x < image.cols; x++) {
+			out[x] = src[x] * win[x];
+		}
+	}
+}
+
+// Divide CCS packed spectrum by its magnitude the same way as cv::phaseCorrelate does
+static void normalizeSpectrum(cv::Mat& spectrum)
+{
+	const double eps = FLT_EPSILON;
+	int rows = spectrum.rows, cols = spectrum.cols;
+
+	auto divide = [eps](float& re, float& im) {
+		double mag = std::sqrt((double)re * re + (double)im * im);
+		double denom = mag * mag + eps;
+		re = re * mag / denom;
+		im = im * mag / denom;
+	};
+
+	// the first column and the last one for even width are spectra of real columns
+	for (int k = 0; k < (cols % 2 ? 1 : 2); k++) {
+		int x = k == 0 ? 0 : cols - 1;
+		float& first = spectrum.at<float>(0, x);
+		first /= std::abs(first) + eps;
+		if (rows % 2 == 0) {
+			float& last = spectrum.at<float>(rows - 1, x);
+			last /= std::abs(last) + eps;
+		}
+		for (int y = 1; y <= rows - 2; y += 2) {
+			divide(spectrum.at<float>(y, x), spectrum.at<float>(y + 1, x));
+		}
+	}
+
+	int end = cols - (cols % 2 == 0);
+	for (int y = 0; y < rows; y++) {
+		float *row = spectrum.ptr<float>(y);
+		for (int x = 1; x < end; x += 2) {
+			divide(row[x], row[x + 1]);
+		}
+	}
+}
+
+void PhaseCorrelator::init(cv::Size size)
+{
+	if (size == size_) return;
+
+	size_ = size;
+	dft_size_ = cv::Size(cv::getOptimalDFTSize(size.width), cv::getOptimalDFTSize(size.height));
+	cv::createHanningWindow(window_, size, CV_32F);
+	has_prev_ = false;
+
+	fixed_.reset();
+	if (fixed_point_ && size.width == size.height) {
+		fixed_ = FixedPointCorrelator::create(size.width);
+	}
+	if (fixed_) {
+		fixed_->setWindow(window_.ptr<float>());
+		prev_.create(1, fixed_->spectrumSize(), CV_16S);
+		curr_.create(1, fixed_->spectrumSize(), CV_16S);
+		return;
+	}
+
+	padded_ = cv::Mat::zeros(dft_size_, CV_32F); // padding stays zero
+	prev_.create(dft_size_, CV_32F);
+	curr_.create(dft_size_, CV_32F);
+	cross_.create(dft_size_, CV_32F);
+	corr_.create(dft_size_, CV_32F);
+}
+
+void PhaseCorrelator::setFixedPoint(bool fixed_point)
+{
+	if (fixed_point == fixed_point_) return;
+	fixed_point_ = fixed_point;
+	size_ = cv::Size(); // reinitialize on the next frame
+	has_prev_ = false;
+}
+
+void PhaseCorrelator::transform(const cv::Mat& image, cv::Mat& spectrum)
+{
+	CV_Assert(image.size() == size_);
+	if (fixed_) {
+		CV_Assert(image.type() == CV_8UC1);
+		spectrum.create(1, fixed_->spectrumSize(), CV_16S);
+		fixed_->transform(image.data, image.step, spectrum.ptr<int16_t>());
+		return;
+	}
+
+	cv::Mat roi = padded_(cv::Rect(cv::Point(0, 0), size_));
+	if (image.type() == CV_8UC1) {
+		applyWindow(image, window_, roi);
+	} else {
+		image.convertTo(roi, CV_32F);
+		cv::multiply(roi, window_, roi);
+	}
+	cv::dft(padded_, spectrum); // packed (CCS) spectrum
+}
+
+cv::Point2d PhaseCorrelator::correlate(const cv::Mat& spectrum1, const cv::Mat& spectrum2, double *response)
+{
+	if (fixed_) {
+		CV_Assert(spectrum1.type() == CV_16S && spectrum2.type() == CV_16S);
+		cv::Point2d shift;
+		fixed_->correlate(spectrum1.ptr<int16_t>(), spectrum2.ptr<int16_t>(), shift.x, shift.y, response);
+		return shift;
+	}
+
+	// normalized cross-power spectrum
+	cv::mulSpectrums(spectrum1, spectrum2, cross_, 0, true);
+	normalizeSpectrum(cross_);
+	cv::idft(cross_, corr_, cv::DFT_REAL_OUTPUT);
+
+	// find the peak and its weighted centroid in 5x5 window, wrapping around (instead of fftShift)
+	cv::Point peak;
+	cv::minMaxLoc(corr_, nullptr, nullptr, nullptr, &peak);
+
+	double sum = 0, sum_x = 0, sum_y = 0;
+	for (int dy = -2; dy <= 2; dy++) {
+		const float *row = corr_.ptr<float>((peak.y + dy + corr_.rows) % corr_.rows);
+		for (int dx = -2; dx <= 2; dx++) {
+			double val = row[(peak.x + dx + corr_.cols) % corr_.cols];
+			sum += val;
+			sum_x += val * dx;
+			sum_y += val * dy;
+		}
+	}
+
+	// peak position relative to zero shift
+	double x = peak.x >= corr_.cols / 2 ? peak.x - corr_.cols : peak.x;
+	double y = peak.y >= corr_.rows / 2 ? peak.y - corr_.rows : peak.y;
+	if (sum != 0) {
+		x += sum_x / sum;
+		y += sum_y / sum;
+	}
+
+	if (response) {
+		*response = sum / corr_.total(); // max response is the number of elements
+	}
+	return cv::Point2d(-x, -y);
+}
+
+void PhaseCorrelator::setCurrent(const cv::Mat& image)
+{
+	init(image.size());
+	transform(image, curr_);
+}
+
+void PhaseCorrelator::next()
+{
+	std::swap(prev_, curr_); // reuse the buffer
+	has_prev_ = true;
+}
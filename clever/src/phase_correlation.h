@@ -0,0 +1,56 @@
+/*
+ * Phase correlation with reuse of the reference frame spectrum
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include "phase_correlation_fixed.h"
+
+// Equivalent of cv::phaseCorrelate with Hanning window, that transforms every frame only once
+// and keeps all the buffers between calls
+class PhaseCorrelator
+{
+public:
+	// Prepare for images of the given size
+	void init(cv::Size size);
+
+	// Use the fixed-point kernel for images of 64, 128 or 256 pixels square size, that should be mono8 then
+	void setFixedPoint(bool fixed_point);
+
+	// Forget the previous frame
+	void reset() { has_prev_ = false; }
+
+	bool hasPrevious() const { return has_prev_; }
+
+	// Calculate windowed spectrum of the image (mono8 or float); the spectrum is CV_16S when the fixed-point kernel is used
+	void transform(const cv::Mat& image, cv::Mat& spectrum);
+
+	// Shift of the second image relative to the first one, as returned by cv::phaseCorrelate
+	cv::Point2d correlate(const cv::Mat& spectrum1, const cv::Mat& spectrum2, double *response = nullptr);
+
+	// Set the current image
+	void setCurrent(const cv::Mat& image);
+
+	// Shift of the current image relative to the previous one
+	cv::Point2d correlate(double *response = nullptr) { return correlate(prev_, curr_, response); }
+
+	// Make the current image the previous one
+	void next();
+
+	const cv::Mat& previous() const { return prev_; }
+	const cv::Mat& current() const { return curr_; }
+
+private:
+	cv::Size size_, dft_size_;
+	cv::Mat window_, padded_, prev_, curr_, cross_, corr_;
+	bool has_prev_ = false;
+	bool fixed_point_ = false;
+	std::unique_ptr<FixedPointCorrelator> fixed_;
+};
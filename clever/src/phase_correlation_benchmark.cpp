@@ -0,0 +1,74 @@
+/*
+ * Benchmark of PhaseCorrelator against cv::phaseCorrelate
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include "phase_correlation.h"
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+	const int sizes[] = {64, 128, 256};
+	const cv::Point2d true_shift(3.0, -2.0);
+
+	// textured frame and its shifted copy
+	cv::Mat frame(512, 512, CV_8UC1);
+	cv::randu(frame, 0, 256);
+	cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+	cv::Mat shifted;
+	cv::Matx23d m(1, 0, true_shift.x, 0, 1, true_shift.y);
+	cv::warpAffine(frame, shifted, m, frame.size());
+
+	printf("%6s %16s %16s %16s %10s %18s %18s %18s\n", "roi", "phaseCorrelate", "PhaseCorrelator", "fixed point",
+	       "90 fps CPU", "shift (opencv)", "shift (ours)", "shift (fixed)");
+
+	for (int size : sizes) {
+		cv::Rect rect((frame.cols - size) / 2, (frame.rows - size) / 2, size, size);
+		cv::Mat prev = frame(rect), curr = shifted(rect);
+
+		// OpenCV: conversion, windowing and both transforms every frame
+		cv::Mat hann, prev_f, curr_f;
+		cv::createHanningWindow(hann, rect.size(), CV_32F);
+		cv::Point2d opencv_shift;
+		int64 start = cv::getTickCount();
+		for (int i = 0; i < iterations; i++) {
+			prev.convertTo(prev_f, CV_32F);
+			curr.convertTo(curr_f, CV_32F);
+			opencv_shift = cv::phaseCorrelate(prev_f, curr_f, hann);
+		}
+		double opencv_time = (cv::getTickCount() - start) / cv::getTickFrequency() / iterations;
+
+		// PhaseCorrelator: one transform per frame, as in the optical flow nodelet
+		auto measure = [&](bool fixed_point, cv::Point2d& shift) {
+			PhaseCorrelator correlator;
+			correlator.setFixedPoint(fixed_point);
+			correlator.setCurrent(prev);
+			correlator.next();
+			int64 start = cv::getTickCount();
+			for (int i = 0; i < iterations; i++) {
+				correlator.setCurrent(i % 2 ? prev : curr);
+				shift = correlator.correlate();
+				correlator.next();
+			}
+			// with even iterations count the last one correlates frames in the reverse order
+			if (iterations % 2 == 0) shift = -shift;
+			return (cv::getTickCount() - start) / cv::getTickFrequency() / iterations;
+		};
+		cv::Point2d shift, fixed_shift;
+		double time = measure(false, shift);
+		double fixed_time = measure(true, fixed_shift);
+
+		printf("%6d %13.1f us %13.1f us %13.1f us %9.1f%% %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", size,
+		       opencv_time * 1e6, time * 1e6, fixed_time * 1e6, fixed_time * 90 * 100,
+		       opencv_shift.x, opencv_shift.y, shift.x, shift.y, fixed_shift.x, fixed_shift.y);
+	}
+
+	return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * Fixed-point phase correlation kernel for power of two ROI sizes
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "phase_correlation_fixed.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FIXED_NEON
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define FIXED_SSSE3
+#endif
+
+// Eight int16 values, mapped to a NEON or SSE register by the compiler
+typedef int16_t v8s __attribute__((vector_size(16)));
+
+static inline v8s load(const int16_t *ptr)
+{
+	v8s v;
+	memcpy(&v, ptr, sizeof(v));
+	return v;
+}
+
+static inline void store(int16_t *ptr, v8s v)
+{
+	memcpy(ptr, &v, sizeof(v));
+}
+
+// Load eight uint8 values, widening them
+static inline v8s load(const uint8_t *ptr)
+{
+#if defined(FIXED_NEON)
+	return (v8s)vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr)));
+#elif defined(FIXED_SSSE3)
+	return (v8s)_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)ptr), _mm_setzero_si128());
+#else
+	v8s v;
+	for (int i = 0; i < 8; i++) {
+		v[i] = ptr[i];
+	}
+	return v;
+#endif
+}
+
+static inline v8s splat(int16_t value)
+{
+	return v8s{value, value, value, value, value, value, value, value};
+}
+
+// Q15 multiplication with rounding: (a * b + 2^14) >> 15
+static inline v8s mulq15(v8s a, v8s b)
+{
+#if defined(FIXED_NEON)
+	return (v8s)vqrdmulhq_s16((int16x8_t)a, (int16x8_t)b);
+#elif defined(FIXED_SSSE3)
+	return (v8s)_mm_mulhrs_epi16((__m128i)a, (__m128i)b);
+#else
+	v8s r;
+	for (int i = 0; i < 8; i++) {
+		r[i] = (a[i] * b[i] + (1 << 14)) >> 15;
+	}
+	return r;
+#endif
+}
+
+static inline v8s vmax(v8s a, v8s b)
+{
+#if defined(FIXED_NEON)
+	return (v8s)vmaxq_s16((int16x8_t)a, (int16x8_t)b);
+#elif defined(FIXED_SSSE3)
+	return (v8s)_mm_max_epi16((__m128i)a, (__m128i)b);
+#else
+	return a > b ? a : b;
+#endif
+}
+
+static inline v8s vmin(v8s a, v8s b)
+{
+#if defined(FIXED_NEON)
+	return (v8s)vminq_s16((int16x8_t)a, (int16x8_t)b);
+#elif defined(FIXED_SSSE3)
+	return (v8s)_mm_min_epi16((__m128i)a, (__m128i)b);
+#else
+	return a < b ? a : b;
+#endif
+}
+
+// Maximum absolute value given lane-wise maximums and minimums
+static inline int range(v8s max, v8s min)
+{
+	int result = 0;
+	for (int i = 0; i < 8; i++) {
+		result = std::max(result, std::max((int)max[i], -(int)min[i]));
+	}
+	return result;
+}
+
+// Number of bits of the absolute value
+static inline int bits(int value)
+{
+	value = std::abs(value);
+	int n = 0;
+	while (value >> n) n++;
+	return n;
+}
+
+// Values are kept below 2^13 between the FFT stages, so that the butterflies fit into int16
+static const int VALUE_BITS = 13;
+// Cross-power spectrum precision
+static const int CROSS_BITS = 12;
+
+template<int N>
+class FixedPointCorrelatorImpl : public FixedPointCorrelator
+{
+	static_assert(N >= 16 && (N & (N - 1)) == 0, "size should be a power of two");
+
+	static const int HALF = N / 2;
+	// spectrum has HALF + 1 columns, rows are padded to the vector size
+	static const int LANES = HALF + 8;
+	static const int PLANE = N * LANES;
+
+public:
+	FixedPointCorrelatorImpl() :
+		window_(N * N, 32767),
+		re_(N * HALF),
+		im_(N * HALF),
+		cross_(2 * PLANE)
+	{
+		for (int j = 0; j < HALF; j++) {
+			// clamped symmetrically, as the sign is inverted for the inverse transform
+			tw_re_[j] = std::max(-32767L, std::min(32767L, std::lround(std::cos(2 * M_PI * j / N) * (1 << 15))));
+			tw_im_[j] = std::max(-32767L, std::min(32767L, std::lround(-std::sin(2 * M_PI * j / N) * (1 << 15))));
+		}
+		for (int i = 0; i < N; i++) {
+			int r = 0;
+			for (int bit = 1, rbit = N >> 1; bit < N; bit <<= 1, rbit >>= 1) {
+				if (i & bit) r |= rbit;
+			}
+			rev_[i] = r;
+		}
+	}
+
+	int spectrumSize() const override { return 2 * PLANE; }
+
+	void setWindow(const float *window) override
+	{
+		for (int i = 0; i < N * N; i++) {
+			window_[i] = std::min(32767L, std::lround(window[i] * (1 << 15)));
+		}
+	}
+
+	void transform(const uint8_t *image, size_t step, int16_t *spectrum) override
+	{
+		// The mean is subtracted, so that the fixed-point range is spent on the texture
+		// rather than on the DC component
+		int sum = 0;
+		for (int y = 0; y < N; y++) {
+			const uint8_t *src = image + y * step;
+			for (int x = 0; x < N; x++) {
+				sum += src[x];
+			}
+		}
+		int mean = (sum + N * N / 2) / (N * N);
+
+		// Pack pairs of windowed columns to complex values: left half to the real part, right half to the imaginary.
+		// Rows are put in bit-reversed order for the FFT.
+		v8s vmean = splat(mean);
+		v8s in_max = {}, in_min = {};
+		for (int y = 0; y < N; y++) {
+			const uint8_t *src = image + y * step;
+			const int16_t *win = &window_[y * N];
+			int16_t *re = &re_[rev_[y] * HALF], *im = &im_[rev_[y] * HALF];
+			for (int x = 0; x < HALF; x += 8) {
+				// (src - mean) * window / 2^10, |value| < 2^13
+				v8s r = mulq15((load(src + x) - vmean) << 5, load(win + x));
+				v8s i = mulq15((load(src + x + HALF) - vmean) << 5, load(win + x + HALF));
+				store(re + x, r);
+				store(im + x, i);
+				in_max = vmax(in_max, vmax(r, i));
+				in_min = vmin(in_min, vmin(r, i));
+			}
+		}
+		fft(re_.data(), im_.data(), HALF, false, bits(range(in_max, in_min)));
+
+		// Separate spectra of the columns using their symmetry and transpose, so that rows are image columns
+		int16_t *s_re = spectrum, *s_im = spectrum + PLANE;
+		int max = 0;
+		for (int ky = 0; ky <= HALF; ky++) {
+			const int16_t *zr = &re_[ky * HALF], *zi = &im_[ky * HALF];
+			const int16_t *mr = &re_[((N - ky) & (N - 1)) * HALF], *mi = &im_[((N - ky) & (N - 1)) * HALF];
+			for (int x = 0; x < HALF; x++) {
+				int a = rev_[x] * LANES + ky, b = rev_[x + HALF] * LANES + ky;
+				s_re[a] = (zr[x] + mr[x]) >> 1;
+				s_im[a] = (zi[x] - mi[x]) >> 1;
+				s_re[b] = (zi[x] + mi[x]) >> 1;
+				s_im[b] = (mr[x] - zr[x]) >> 1;
+				max = std::max(max, std::max(std::max(std::abs(s_re[a]), std::abs(s_im[a])),
+				                             std::max(std::abs(s_re[b]), std::abs(s_im[b]))));
+			}
+		}
+		for (int x = 0; x < N; x++) {
+			std::fill(s_re + x * LANES + HALF + 1, s_re + (x + 1) * LANES, 0);
+			std::fill(s_im + x * LANES + HALF + 1, s_im + (x + 1) * LANES, 0);
+		}
+		fft(s_re, s_im, LANES, false, bits(max));
+	}
+
+	void correlate(const int16_t *spectrum1, const int16_t *spectrum2, double& x, double& y, double *response) override
+	{
+		crossPowerSpectrum(spectrum1, spectrum2);
+
+		// inverse transform along the rows of the spectrum
+		int16_t *c_re = cross_.data(), *c_im = cross_.data() + PLANE;
+		int exponent = fft(c_re, c_im, LANES, true, CROSS_BITS + 1);
+
+		// Restore full spectra of the columns from the halves and pack pairs of them to complex values,
+		// transposing back, so that rows are image rows
+		int max = 0;
+		for (int ky = 0; ky < N; ky++) {
+			bool conj = ky > HALF;
+			int k = conj ? N - ky : ky;
+			int16_t *re = &re_[rev_[ky] * HALF], *im = &im_[rev_[ky] * HALF];
+			for (int x = 0; x < HALF; x++) {
+				int ar = c_re[x * LANES + k], ai = c_im[x * LANES + k];
+				int br = c_re[(x + HALF) * LANES + k], bi = c_im[(x + HALF) * LANES + k];
+				if (conj) {
+					ai = -ai;
+					bi = -bi;
+				}
+				re[x] = (ar - bi) >> 1;
+				im[x] = (ai + br) >> 1;
+				max = std::max(max, std::max(std::abs(re[x]), std::abs(im[x])));
+			}
+		}
+		exponent += 1;
+		exponent += fft(re_.data(), im_.data(), HALF, true, bits(max));
+
+		// find the peak and its weighted centroid in 5x5 window, wrapping around, as PhaseCorrelator does
+		int peak_x = 0, peak_y = 0;
+		int peak = re_[0];
+		for (int i = 0; i < N * HALF; i++) {
+			if (re_[i] > peak) {
+				peak = re_[i];
+				peak_x = i % HALF;
+				peak_y = i / HALF;
+			}
+		}
+		for (int i = 0; i < N * HALF; i++) {
+			if (im_[i] > peak) {
+				peak = im_[i];
+				peak_x = i % HALF + HALF;
+				peak_y = i / HALF;
+			}
+		}
+
+		double sum = 0, sum_x = 0, sum_y = 0;
+		for (int dy = -2; dy <= 2; dy++) {
+			for (int dx = -2; dx <= 2; dx++) {
+				double val = value((peak_x + dx) & (N - 1), (peak_y + dy) & (N - 1));
+				sum += val;
+				sum_x += val * dx;
+				sum_y += val * dy;
+			}
+		}
+
+		// peak position relative to zero shift
+		x = peak_x >= HALF ? peak_x - N : peak_x;
+		y = peak_y >= HALF ? peak_y - N : peak_y;
+		if (sum != 0) {
+			x += sum_x / sum;
+			y += sum_y / sum;
+		}
+		x = -x;
+		y = -y;
+
+		if (response) {
+			// Same scale as the floating point inverse DFT. The window sum may slightly exceed 1 on subpixel shifts,
+			// more often than with cv::phaseCorrelate, as the mean subtraction removes the windowed DC leakage.
+			*response = std::max(0.0, std::min(1.0, std::ldexp(sum, exponent - CROSS_BITS) / (N * N)));
+		}
+	}
+
+private:
+	std::vector<int16_t> window_; // Q15
+	std::vector<int16_t> re_, im_, cross_;
+	int16_t tw_re_[HALF], tw_im_[HALF];
+	int rev_[N];
+
+	// Value of the correlation at the point, after the inverse transform
+	int value(int x, int y) const
+	{
+		return x < HALF ? re_[y * HALF + x] : im_[y * HALF + x - HALF];
+	}
+
+	// Radix-2 FFT along the N rows of `lanes` complex values, that are given in bit-reversed order.
+	// Values are scaled down when needed to be kept below 2^VALUE_BITS (block floating point),
+	// the total scaling exponent is returned. `input_bits` is the number of bits of the input absolute values.
+	int fft(int16_t *re, int16_t *im, int lanes, bool inverse, int input_bits)
+	{
+		int exponent = 0;
+		int value_bits = input_bits;
+		for (int len = 2, step = HALF; len <= N; len <<= 1, step >>= 1) {
+			// the output may grow up to 1 + sqrt(2) times, that takes less than 2 bits
+			int shift = std::max(0, value_bits + 2 - VALUE_BITS);
+			v8s round = splat(shift ? 1 << (shift - 1) : 0);
+			exponent += shift;
+
+			v8s out_max = {}, out_min = {};
+			int half = len / 2;
+			for (int i = 0; i < N; i += len) {
+				for (int j = 0; j < half; j++) {
+					v8s wr = splat(tw_re_[j * step]);
+					v8s wi = splat(inverse ? -tw_im_[j * step] : tw_im_[j * step]);
+					int16_t *ar = re + (i + j) * lanes, *ai = im + (i + j) * lanes;
+					int16_t *br = re + (i + j + half) * lanes, *bi = im + (i + j + half) * lanes;
+					for (int k = 0; k < lanes; k += 8) {
+						v8s xr = load(ar + k) + round, xi = load(ai + k) + round;
+						v8s yr = load(br + k), yi = load(bi + k);
+						v8s tr = mulq15(yr, wr) - mulq15(yi, wi);
+						v8s ti = mulq15(yr, wi) + mulq15(yi, wr);
+						v8s r0 = (xr + tr) >> shift, i0 = (xi + ti) >> shift;
+						v8s r1 = (xr - tr) >> shift, i1 = (xi - ti) >> shift;
+						store(ar + k, r0);
+						store(ai + k, i0);
+						store(br + k, r1);
+						store(bi + k, i1);
+						out_max = vmax(out_max, vmax(vmax(r0, i0), vmax(r1, i1)));
+						out_min = vmin(out_min, vmin(vmin(r0, i0), vmin(r1, i1)));
+					}
+				}
+			}
+
+			value_bits = bits(range(out_max, out_min));
+		}
+		return exponent;
+	}
+
+	// Normalized cross-power spectrum in CROSS_BITS fixed point, with rows in bit-reversed order
+	void crossPowerSpectrum(const int16_t *spectrum1, const int16_t *spectrum2)
+	{
+		const float scale = 1 << CROSS_BITS;
+		int16_t *c_re = cross_.data(), *c_im = cross_.data() + PLANE;
+		for (int kx = 0; kx < N; kx++) {
+			const int16_t *ar = spectrum1 + kx * LANES, *ai = spectrum1 + PLANE + kx * LANES;
+			const int16_t *br = spectrum2 + kx * LANES, *bi = spectrum2 + PLANE + kx * LANES;
+			int16_t *cr = c_re + rev_[kx] * LANES, *ci = c_im + rev_[kx] * LANES;
+			for (int ky = 0; ky <= HALF; ky++) {
+				float pr = (float)ar[ky] * br[ky] + (float)ai[ky] * bi[ky];
+				float pi = (float)ai[ky] * br[ky] - (float)ar[ky] * bi[ky];
+				// zero stays zero, as the magnitude is only used as the divisor
+				float k = scale / std::sqrt(pr * pr + pi * pi + FLT_MIN);
+				cr[ky] = lrintf(pr * k);
+				ci[ky] = lrintf(pi * k);
+			}
+			std::fill(cr + HALF + 1, cr + LANES, 0);
+			std::fill(ci + HALF + 1, ci + LANES, 0);
+		}
+	}
+};
+
+std::unique_ptr<FixedPointCorrelator> FixedPointCorrelator::create(int size)
+{
+	switch (size) {
+		case 64: return std::unique_ptr<FixedPointCorrelator>(new FixedPointCorrelatorImpl<64>());
+		case 128: return std::unique_ptr<FixedPointCorrelator>(new FixedPointCorrelatorImpl<128>());
+		case 256: return std::unique_ptr<FixedPointCorrelator>(new FixedPointCorrelatorImpl<256>());
+		default: return nullptr;
+	}
+}
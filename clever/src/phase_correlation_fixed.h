@@ -0,0 +1,41 @@
+/*
+ * Fixed-point phase correlation kernel for power of two ROI sizes
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Phase correlation of mono8 square images with 16-bit fixed-point FFT, sized at compile time
+// (64, 128 and 256 are supported) and vectorized with NEON or SSSE3 when available. Conversion,
+// windowing and the first FFT pass are done in one loop. The image mean is subtracted before windowing,
+// so the shifts match cv::phaseCorrelate within the fixed-point precision, and the response, clamped to [0, 1],
+// is a few percent higher.
+class FixedPointCorrelator
+{
+public:
+	virtual ~FixedPointCorrelator() {}
+
+	// Create correlator for images of the given size, returns null if the size is not supported
+	static std::unique_ptr<FixedPointCorrelator> create(int size);
+
+	// Number of int16 values in the spectrum
+	virtual int spectrumSize() const = 0;
+
+	// Set the window (size x size floats)
+	virtual void setWindow(const float *window) = 0;
+
+	// Calculate windowed spectrum of the image
+	virtual void transform(const uint8_t *image, size_t step, int16_t *spectrum) = 0;
+
+	// Shift of the second image relative to the first one
+	virtual void correlate(const int16_t *spectrum1, const int16_t *spectrum2,
+	                       double& x, double& y, double *response) = 0;
+};
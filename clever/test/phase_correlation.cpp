@@ -0,0 +1,205 @@
+/*
+ * PhaseCorrelator tests
+ * Copyright (C) 2026 Copter Express Technologies
+ *
+ * Distributed under MIT License (available at https://opensource.org/licenses/MIT).
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include "../src/phase_correlation.h"
+
+// Textured frame and its copy shifted by the given amount
+static void makeFrames(cv::Size size, cv::Point2d shift, cv::Mat& frame, cv::Mat& shifted)
+{
+	cv::RNG rng(42);
+	frame.create(size, CV_8UC1);
+	rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+	cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+	cv::Matx23d m(1, 0, shift.x, 0, 1, shift.y);
+	cv::warpAffine(frame, shifted, m, frame.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT);
+}
+
+static cv::Point2d phaseCorrelate(const cv::Mat& prev, const cv::Mat& curr, double *response)
+{
+	cv::Mat hann, prev_f, curr_f;
+	cv::createHanningWindow(hann, prev.size(), CV_32F);
+	prev.convertTo(prev_f, CV_32F);
+	curr.convertTo(curr_f, CV_32F);
+	return cv::phaseCorrelate(prev_f, curr_f, hann, response);
+}
+
+static void expectSameAsOpenCV(cv::Size size, cv::Point2d shift)
+{
+	cv::Mat frame, shifted;
+	makeFrames(cv::Size(size.width * 2, size.height * 2), shift, frame, shifted);
+	cv::Rect rect(size.width / 2, size.height / 2, size.width, size.height);
+	cv::Mat prev = frame(rect), curr = shifted(rect);
+
+	double expected_response;
+	cv::Point2d expected = phaseCorrelate(prev, curr, &expected_response);
+
+	PhaseCorrelator correlator;
+	correlator.setCurrent(prev);
+	correlator.next();
+	correlator.setCurrent(curr);
+	double response;
+	cv::Point2d result = correlator.correlate(&response);
+
+	EXPECT_NEAR(result.x, expected.x, 1e-3) << "size " << size;
+	EXPECT_NEAR(result.y, expected.y, 1e-3) << "size " << size;
+	EXPECT_NEAR(response, expected_response, 1e-4) << "size " << size;
+}
+
+TEST(PhaseCorrelator, sameAsOpenCV)
+{
+	for (int size : {64, 128, 256}) {
+		expectSameAsOpenCV(cv::Size(size, size), cv::Point2d(3, -2));
+		expectSameAsOpenCV(cv::Size(size, size), cv::Point2d(-1.5, 0.25));
+	}
+	// sizes padded for DFT, odd sizes
+	expectSameAsOpenCV(cv::Size(100, 100), cv::Point2d(2, 1));
+	expectSameAsOpenCV(cv::Size(97, 75), cv::Point2d(-2, 3));
+}
+
+TEST(PhaseCorrelator, floatImage)
+{
+	cv::Mat frame, shifted, frame_f, shifted_f;
+	makeFrames(cv::Size(128, 128), cv::Point2d(4, 2), frame, shifted);
+	frame.convertTo(frame_f, CV_32F);
+	shifted.convertTo(shifted_f, CV_32F);
+
+	PhaseCorrelator correlator, correlator_f;
+	correlator.setCurrent(frame);
+	correlator.next();
+	correlator.setCurrent(shifted);
+	correlator_f.setCurrent(frame_f);
+	correlator_f.next();
+	correlator_f.setCurrent(shifted_f);
+
+	double response, response_f;
+	cv::Point2d result = correlator.correlate(&response);
+	cv::Point2d result_f = correlator_f.correlate(&response_f);
+	EXPECT_NEAR(result.x, result_f.x, 1e-4);
+	EXPECT_NEAR(result.y, result_f.y, 1e-4);
+	EXPECT_NEAR(response, response_f, 1e-5);
+}
+
+TEST(PhaseCorrelator, sequence)
+{
+	// reusing the previous frame spectrum gives the same results as correlating the frames pairwise
+	const cv::Point2d step(1.25, -0.5);
+	cv::Mat frame, shifted;
+	makeFrames(cv::Size(256, 256), cv::Point2d(0, 0), frame, shifted);
+	cv::Rect rect(64, 64, 64, 64);
+
+	PhaseCorrelator correlator;
+	cv::Mat prev;
+	for (int i = 0; i < 5; i++) {
+		cv::Matx23d m(1, 0, step.x * i, 0, 1, step.y * i);
+		cv::Mat curr;
+		cv::warpAffine(frame, curr, m, frame.size());
+		curr = curr(rect).clone();
+
+		correlator.setCurrent(curr);
+		EXPECT_EQ(correlator.hasPrevious(), i > 0);
+		if (correlator.hasPrevious()) {
+			double response, expected_response;
+			cv::Point2d shift = correlator.correlate(&response);
+			cv::Point2d expected = phaseCorrelate(prev, curr, &expected_response);
+			EXPECT_NEAR(shift.x, expected.x, 1e-3);
+			EXPECT_NEAR(shift.y, expected.y, 1e-3);
+			EXPECT_NEAR(response, expected_response, 1e-4);
+			EXPECT_NEAR(shift.x, step.x, 0.2);
+			EXPECT_NEAR(shift.y, step.y, 0.2);
+		}
+		correlator.next();
+		prev = curr;
+	}
+
+	correlator.reset();
+	EXPECT_FALSE(correlator.hasPrevious());
+}
+
+static cv::Point2d correlateFixedPoint(const cv::Mat& prev, const cv::Mat& curr, double *response)
+{
+	PhaseCorrelator correlator;
+	correlator.setFixedPoint(true);
+	correlator.setCurrent(prev);
+	correlator.next();
+	correlator.setCurrent(curr);
+	EXPECT_EQ(correlator.current().type(), CV_16S) << "size " << prev.size();
+	return correlator.correlate(response);
+}
+
+TEST(PhaseCorrelator, fixedPoint)
+{
+	// Fixed-point kernel subtracts the image mean before windowing, so its results differ from cv::phaseCorrelate
+	// a little, mostly on small sizes
+	for (int size : {128, 256}) {
+		for (auto shift : {cv::Point2d(3, -2), cv::Point2d(0.4, 0.1), cv::Point2d(10.3, -7.7)}) {
+			cv::Mat frame, shifted;
+			makeFrames(cv::Size(size * 2, size * 2), shift, frame, shifted);
+			cv::Rect rect(size / 2, size / 2, size, size);
+
+			double response, expected_response;
+			cv::Point2d result = correlateFixedPoint(frame(rect), shifted(rect), &response);
+			cv::Point2d expected = phaseCorrelate(frame(rect), shifted(rect), &expected_response);
+			EXPECT_NEAR(result.x, expected.x, 0.1) << "size " << size;
+			EXPECT_NEAR(result.y, expected.y, 0.1) << "size " << size;
+			EXPECT_NEAR(response, expected_response, 0.1) << "size " << size;
+		}
+	}
+
+	for (int size : {64, 128, 256}) {
+		cv::Mat frame, shifted;
+		makeFrames(cv::Size(size * 2, size * 2), cv::Point2d(3, -2), frame, shifted);
+		cv::Rect rect(size / 2, size / 2, size, size);
+		cv::Point2d result = correlateFixedPoint(frame(rect), shifted(rect), nullptr);
+		EXPECT_NEAR(result.x, 3, 0.15) << "size " << size;
+		EXPECT_NEAR(result.y, -2, 0.15) << "size " << size;
+	}
+}
+
+TEST(PhaseCorrelator, fixedPointResponseRange)
+{
+	// the response is used as the flow quality, so it should be in [0, 1] like cv::phaseCorrelate's one
+	for (int size : {64, 128}) {
+		for (auto shift : {cv::Point2d(0, 0), cv::Point2d(0.4, 0.1), cv::Point2d(-1.5, 0.25), cv::Point2d(5.5, 2.3)}) {
+			cv::Mat frame, shifted;
+			makeFrames(cv::Size(size * 2, size * 2), shift, frame, shifted);
+			cv::Rect rect(size / 2, size / 2, size, size);
+			double response;
+			correlateFixedPoint(frame(rect), shifted(rect), &response);
+			EXPECT_LE(response, 1) << "size " << size << " shift " << shift;
+			EXPECT_GE(response, 0.5) << "size " << size << " shift " << shift;
+		}
+	}
+}
+
+TEST(PhaseCorrelator, fixedPointUnsupportedSize)
+{
+	// falls back to the floating point DFT
+	cv::Mat frame, shifted;
+	makeFrames(cv::Size(200, 200), cv::Point2d(2, 1), frame, shifted);
+	cv::Rect rect(50, 50, 100, 100);
+
+	PhaseCorrelator correlator;
+	correlator.setFixedPoint(true);
+	correlator.setCurrent(frame(rect));
+	EXPECT_EQ(correlator.current().type(), CV_32F);
+	correlator.next();
+	correlator.setCurrent(shifted(rect));
+	cv::Point2d result = correlator.correlate();
+	cv::Point2d expected = phaseCorrelate(frame(rect), shifted(rect), nullptr);
+	EXPECT_NEAR(result.x, expected.x, 1e-3);
+	EXPECT_NEAR(result.y, expected.y, 1e-3);
+}
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}